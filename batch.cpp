@@ -0,0 +1,41 @@
+#include "batch.hpp"
+
+#include "error.hpp"
+
+namespace BASIC {
+
+std::vector<std::string> run_batch(program& prog, machine::engine_type engine,
+	const std::vector<std::vector<integer_t>>& inputs, thread_pool& pool)
+{
+	{
+		session_machine vm;
+		vm.set_engine(engine);
+		vm.prepare(prog);
+	}
+	const program& shared = prog;
+	std::vector<std::string> results(inputs.size());
+	for (std::size_t i = 0; i < inputs.size(); ++i) {
+		pool.submit([&shared, engine, &inputs, &results, i]() {
+			session_machine vm;
+			vm.set_engine(engine);
+			std::string error;
+			try {
+				auto status = vm.run(shared);
+				for (auto n : inputs[i]) {
+					if (status != machine::RUN_WAITING)
+						break;
+					status = vm.feed(shared, n);
+				}
+				if (status == machine::RUN_WAITING)
+					throw error::end_of_file();
+			} catch (error::basic_error& e) {
+				error = std::string(e.what()) + '\n';
+			}
+			results[i] = vm.take_output() + error;
+		});
+	}
+	pool.wait();
+	return results;
+}
+
+} // namespace BASIC
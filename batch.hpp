@@ -0,0 +1,21 @@
+#ifndef BASIC_BATCH_HPP
+#define BASIC_BATCH_HPP
+
+#include "common.hpp"
+
+#include "session_machine.hpp"
+#include "thread_pool.hpp"
+
+namespace BASIC {
+
+// Run a program once for each set of inputs, on the threads of pool, each
+// with a machine of its own. The program is prepared once for the engine
+// and shared by all of them. Return the output of each run, ended with the
+// message of the error that stopped it if any, in the order of the inputs.
+// A run that wants more input than given stops at END OF FILE.
+std::vector<std::string> run_batch(program& prog, machine::engine_type engine,
+	const std::vector<std::vector<integer_t>>& inputs, thread_pool& pool);
+
+} // namespace BASIC
+
+#endif // BASIC_BATCH_HPP
@@ -0,0 +1,25 @@
+10 REM division heavy: digit sums and Euclid's GCD of I and N - I
+20 INPUT N
+30 LET T = 0
+40 LET G = 0
+50 LET I = 1
+60 LET X = I
+70 LET D = X - X / 10 * 10
+80 LET T = T + D
+90 LET X = X / 10
+100 IF X > 0 THEN 70
+110 LET A = I
+120 LET B = N - I
+130 IF B = 0 THEN 180
+140 LET R = A - A / B * B
+150 LET A = B
+160 LET B = R
+170 GOTO 130
+180 LET G = G + A
+190 LET I = I + 1
+200 IF I < N THEN 60
+210 PRINT T
+220 PRINT G
+230 END
+RUN
+200000
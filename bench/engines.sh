@@ -0,0 +1,68 @@
+#!/bin/bash
+# Run BASIC programs under each execution engine, and report the time of
+# each and the speedup over the switch engine. Programs are fed to the
+# console as they are, so they should end with RUN and their input.
+#
+# The last row, AOT, is the program translated to C++ by TRANSLATE and
+# built with $CXX, as a ceiling for the engines. AOT=no skips it.
+#
+# usage: bench/engines.sh [program.bas...]
+# The binary must be built with -DNOT_LAB2_JUDGE for the ENGINE command.
+
+BIN=${BIN:-./basic-lab2}
+CXX=${CXX:-c++}
+ENGINES=${ENGINES:-"SWITCH THREADED COMPACT JIT"}
+REPEAT=${REPEAT:-3}
+TIMEFORMAT=%R
+
+[ $# -gt 0 ] || set -- "$(dirname "$0")"/*.bas
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+# best wall time of $REPEAT runs of a command, with its output discarded
+best_time() {
+	local best t
+	for ((i = 0; i < REPEAT; ++i)); do
+		t=$( { time "$@" > /dev/null; } 2>&1 )
+		if [ -z "$best" ] || awk "BEGIN { exit !($t < $best) }"; then
+			best=$t
+		fi
+	done
+	echo "$best"
+}
+
+# run program $2 under engine $1
+vm() {
+	{ echo "ENGINE $1"; cat "$2"; } | "$BIN"
+}
+
+# run program $1 built to $2, with what follows the first RUN as input
+aot() {
+	sed '1,/^RUN$/d' "$1" | "$2"
+}
+
+aot_build() {
+	{ sed '/^RUN$/,$d' "$1"; echo "TRANSLATE $2.cpp"; } |
+		"$BIN" > /dev/null && "$CXX" -O2 -o "$2" "$2.cpp"
+}
+
+report() {
+	printf '%-20s %-10s %8s %7.2fx\n' "$(basename "$1")" "$2" "$3" \
+		"$(awk "BEGIN { print $base / $3 }")"
+}
+
+printf '%-20s %-10s %8s %8s\n' PROGRAM ENGINE TIME SPEEDUP
+for prog in "$@"; do
+	base=
+	for engine in $ENGINES; do
+		if [ "$("$BIN" <<< "ENGINE $engine")" = "ENGINE NOT AVAILABLE" ]; then
+			continue
+		fi
+		t=$(best_time vm "$engine" "$prog")
+		[ -n "$base" ] || base=$t
+		report "$prog" "$engine" "$t"
+	done
+	if [ "$AOT" != no ] && aot_build "$prog" "$tmp/prog"; then
+		report "$prog" AOT "$(best_time aot "$prog" "$tmp/prog")"
+	fi
+done
@@ -0,0 +1,202 @@
+// Front-end benchmark: read a BASIC program from stdin, and put it through
+// each stage before the first instruction runs, as the console does. Print
+// CSV with the time, lines per second and heap use of each stage:
+//	stage,lines,seconds,lines_per_s,peak_bytes,retained_bytes
+// where peak_bytes is the most heap the stage had in use above what there
+// was when it started, and retained_bytes what it still holds at its end.
+//
+// usage: frontend-bench [ENGINE...] < prog.bas
+// Engines to prepare for are as in the ENGINE command, THREADED by default.
+
+#include "../common.hpp"
+
+#include "../compiler.hpp"
+#include "../error.hpp"
+#include "../linker.hpp"
+#include "../session_machine.hpp"
+
+#include <malloc.h>
+
+// GCC sees through the replaced operators below, and warns that memory from
+// malloc() in operator new is freed by operator delete.
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+namespace {
+
+// heap in use, by the global operator new
+std::size_t heap_now;
+std::size_t heap_peak;
+
+} // namespace
+
+void* operator new(std::size_t size)
+{
+	void* p = std::malloc(size ? size : 1);
+	if (!p)
+		throw std::bad_alloc();
+	heap_now += malloc_usable_size(p);
+	heap_peak = std::max(heap_peak, heap_now);
+	return p;
+}
+
+void operator delete(void* p) noexcept
+{
+	if (!p)
+		return;
+	heap_now -= malloc_usable_size(p);
+	std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+	operator delete(p);
+}
+
+namespace {
+
+using namespace BASIC;
+
+void report(const std::string& name, std::size_t lines, double secs,
+	std::size_t peak, std::int64_t retained)
+{
+	std::cout << name << ',' << lines << ',' << secs << ','
+		<< static_cast<std::uint64_t>(lines / secs) << ',' << peak << ','
+		<< retained << std::endl;
+}
+
+class stage {
+public:
+	stage(const char* name, std::size_t lines):
+		name(name),
+		lines(lines),
+		heap_start(heap_now),
+		since(std::chrono::steady_clock::now())
+	{
+		heap_peak = heap_now;
+	}
+	~stage()
+	{
+		double secs = std::chrono::duration<double>(
+			std::chrono::steady_clock::now() - since).count();
+		report(name, lines, secs, heap_peak - heap_start,
+			static_cast<std::int64_t>(heap_now - heap_start));
+	}
+
+private:
+	std::string name;
+	std::size_t lines;
+	std::size_t heap_start;
+	std::chrono::steady_clock::time_point since;
+};
+
+bool engine_of(const std::string& name, machine::engine_type& engine)
+{
+	for (auto e : {machine::ENGINE_SWITCH, machine::ENGINE_THREADED,
+			machine::ENGINE_COMPACT, machine::ENGINE_JIT,
+			machine::ENGINE_CLOSURE, machine::ENGINE_TRACE}) {
+		if (name == machine::engine_name(e)) {
+			engine = e;
+			return true;
+		}
+	}
+	return false;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+	std::vector<std::string> input;
+	std::string s;
+	while (std::getline(std::cin, s))
+		input.push_back(std::move(s));
+	std::size_t n = input.size();
+
+	std::cout << "stage,lines,seconds,lines_per_s,peak_bytes,retained_bytes"
+		<< std::endl;
+	basic_code_t code;
+	{
+		stage st("read", n);
+		for (auto& line : input) {
+			std::size_t offset;
+			auto lineno = std::stoul(line, &offset);
+			code[lineno] = line.substr(offset);
+		}
+	}
+	object_code_t obj;
+	{
+		stage st("compile", n);
+		compiler comp;
+		for (auto& line : code) {
+			try {
+				obj[line.first] = comp.compile(line.second);
+			} catch (error::basic_error& e) {
+				std::cerr << line.first << ": " << e.what()
+					<< std::endl;
+				return 1;
+			}
+		}
+	}
+	symbol_table syms;
+	linker ld(syms);
+	program prog;
+	{
+		stage st("link", n);
+		prog = ld.link(obj);
+	}
+	{
+		// the same in parts, with a table of its own: the passes of
+		// the optimizer on a copy, giving every variable a slot, and
+		// emitting code, of which linking line numbers, which
+		// allocates nothing
+		symbol_table part_syms;
+		linker part(part_syms);
+		auto opt = obj;
+		line_notes_t notes;
+		{
+			stage st("optimize", n);
+			linker::run_optimizer(opt, notes);
+		}
+		{
+			stage st("symbols", n);
+			part.assign_slots(opt, notes);
+		}
+		{
+			stage st("emit", n);
+			part.link(opt, notes);
+		}
+		report("link lines", n, std::chrono::duration<double>(
+			part.lines_time()).count(), 0, 0);
+	}
+	if (!obj.empty()) {
+		// as the console links without optimization: all lines new,
+		// and then after the line in the middle is entered again
+		linker inc(syms);
+		inc.set_optimize(false);
+		{
+			stage st("relink all", n);
+			inc.relink(obj);
+		}
+		inc.invalidate(std::next(obj.begin(), obj.size() / 2)->first);
+		{
+			stage st("relink one", n);
+			inc.relink(obj);
+		}
+	}
+	std::vector<std::string> engines(argv + 1, argv + argc);
+	if (engines.empty())
+		engines.push_back("THREADED");
+	for (auto& name : engines) {
+		machine::engine_type engine;
+		session_machine vm;
+		if (!engine_of(name, engine) || !vm.set_engine(engine)) {
+			std::cerr << "no engine " << name << std::endl;
+			return 1;
+		}
+		stage st(("prepare " + name).c_str(), n);
+		vm.prepare(prog);
+	}
+	return 0;
+}
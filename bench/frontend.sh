@@ -0,0 +1,29 @@
+#!/bin/bash
+# Measure the front end on synthetic programs of growing size from
+# genprog.sh, and print the CSV of frontend-bench for each, prefixed by the
+# parameters of the program.
+#
+# usage: bench/frontend.sh [ENGINE...]
+#	SIZES	numbers of lines, "10000 100000 300000" by default
+#	VARS	variables per line, i.e. LINES / VARS of them; 10 by default
+#	DEPTH	maximum depth of expressions, 3 by default
+#	GOTO	percentage of GOTO and IF lines, 10 by default
+
+BIN=${BIN:-./frontend-bench}
+SIZES=${SIZES:-"10000 100000 300000"}
+VARS=${VARS:-10}
+DEPTH=${DEPTH:-3}
+GOTO=${GOTO:-10}
+
+dir=$(dirname "$0")
+tmp=$(mktemp)
+trap 'rm -f "$tmp"' EXIT
+
+echo "lines,vars,depth,goto,stage,seconds,lines_per_s,peak_bytes,retained_bytes"
+for n in $SIZES; do
+	vars=$(( (n + VARS - 1) / VARS ))
+	"$dir"/genprog.sh "$n" "$vars" "$DEPTH" "$GOTO" > "$tmp"
+	"$BIN" "$@" < "$tmp" | tail -n +2 |
+		awk -F, -v p="$n,$vars,$DEPTH,$GOTO" 'BEGIN { OFS = "," } {
+			print p, $1, $3, $4, $5, $6 }'
+done
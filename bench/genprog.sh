@@ -0,0 +1,51 @@
+#!/bin/bash
+# Write a synthetic BASIC program to stdout, for the front-end benchmark. It
+# is never run, only compiled and linked, but all of it is valid.
+#
+# usage: bench/genprog.sh LINES VARS DEPTH GOTO [SEED]
+#	LINES	number of lines
+#	VARS	number of variables, V0 to V<VARS - 1>
+#	DEPTH	maximum depth of the operator tree of an expression
+#	GOTO	percentage of lines that are GOTO or IF
+# The same arguments always give the same program.
+
+if [ $# -lt 4 ]; then
+	echo "usage: $0 LINES VARS DEPTH GOTO [SEED]" >&2
+	exit 1
+fi
+
+awk -v lines="$1" -v vars="$2" -v depth="$3" -v jumps="$4" -v seed="${5:-1}" '
+function pick(n) {
+	return int(rand() * n)
+}
+function leaf() {
+	return rand() < 0.6 ? "V" pick(vars) : pick(1000)
+}
+# An expression of at most d levels of operators, shallower at random.
+function expr(d) {
+	if (d == 0 || rand() < 0.25)
+		return leaf()
+	return "(" expr(d - 1) " " substr("+-*/", pick(4) + 1, 1) " " \
+		expr(d - 1) ")"
+}
+function target() {
+	return 10 * (pick(lines) + 1)
+}
+BEGIN {
+	srand(seed)
+	for (i = 1; i <= lines; ++i) {
+		printf "%d ", 10 * i
+		r = rand() * 100
+		if (r < jumps / 2)
+			print "GOTO " target()
+		else if (r < jumps)
+			print "IF " expr(depth - 1) " " substr("<=>", pick(3) + 1, 1) \
+				" " expr(depth - 1) " THEN " target()
+		else if (r < jumps + (100 - jumps) / 8)
+			print "PRINT " expr(depth)
+		else if (r < jumps + (100 - jumps) / 4)
+			print "INPUT V" pick(vars)
+		else
+			print "LET V" pick(vars) " = " expr(depth)
+	}
+}'
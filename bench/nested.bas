@@ -0,0 +1,19 @@
+10 REM nested loops: sum of (I * J + K) over an N x N x N cube, through T
+15 REM so that the inner loop reads a value it computes and is not closed
+20 INPUT N
+30 LET S = 0
+40 LET I = 0
+50 LET J = 0
+60 LET K = 0
+70 LET T = I * J + K
+80 LET S = S + T
+90 LET K = K + 1
+100 IF K < N THEN 70
+110 LET J = J + 1
+120 IF J < N THEN 60
+130 LET I = I + 1
+140 IF I < N THEN 50
+150 PRINT S
+160 END
+RUN
+150
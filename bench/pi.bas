@@ -0,0 +1,18 @@
+10 REM count primes up to N, PI(100000) = 9592
+20 INPUT N
+30 LET C = 0
+40 LET I = 2
+50 IF I > N THEN 200
+60 LET J = 2
+70 IF J * J > I THEN 120
+80 LET Q = I / J
+90 IF Q * J = I THEN 150
+100 LET J = J + 1
+110 GOTO 70
+120 LET C = C + 1
+150 LET I = I + 1
+160 GOTO 50
+200 PRINT C
+210 END
+RUN
+100000
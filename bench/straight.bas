@@ -0,0 +1,428 @@
+10 REM long straight-line code: 400 lines of arithmetic, N times
+20 INPUT N
+30 LET V0 = 1
+31 LET V1 = 8
+32 LET V2 = 15
+33 LET V3 = 22
+34 LET V4 = 29
+35 LET V5 = 36
+36 LET V6 = 43
+37 LET V7 = 50
+38 LET V8 = 57
+39 LET V9 = 64
+40 LET V10 = 71
+41 LET V11 = 78
+42 LET V12 = 85
+43 LET V13 = 92
+44 LET V14 = 99
+45 LET V15 = 106
+90 LET I = 0
+100 LET V9 = (V0 + V1 * 5 - V14) / 8 + 10
+110 LET V7 = (V10 + V14 * 2 - V10) / 6 + 33
+120 LET V13 = (V12 + V8 * 4 - V7) / 9 + 16
+130 LET V9 = (V6 + V11 * 1 - V13) / 5 + 22
+140 LET V15 = (V3 + V5 * 2 - V8) / 6 + 45
+150 LET V1 = (V11 + V9 * 2 - V9) / 6 + 19
+160 LET V9 = (V12 + V8 * 3 - V6) / 6 + 83
+170 LET V3 = (V12 + V0 * 1 - V13) / 6 + 66
+180 LET V3 = (V3 + V14 * 3 - V2) / 7 + 71
+190 LET V10 = (V11 + V2 * 3 - V12) / 8 + 33
+200 LET V12 = (V3 + V8 * 5 - V6) / 8 + 79
+210 LET V7 = (V2 + V10 * 5 - V11) / 10 + 57
+220 LET V0 = (V6 + V3 * 3 - V4) / 6 + 43
+230 LET V0 = (V6 + V2 * 1 - V11) / 5 + 49
+240 LET V8 = (V1 + V13 * 2 - V5) / 6 + 76
+250 LET V4 = (V7 + V8 * 3 - V11) / 6 + 46
+260 LET V8 = (V13 + V0 * 2 - V8) / 6 + 81
+270 LET V12 = (V6 + V3 * 4 - V13) / 8 + 57
+280 LET V14 = (V11 + V1 * 4 - V7) / 10 + 84
+290 LET V1 = (V4 + V9 * 4 - V5) / 7 + 5
+300 LET V5 = (V5 + V8 * 1 - V13) / 6 + 39
+310 LET V6 = (V13 + V3 * 2 - V2) / 6 + 2
+320 LET V0 = (V13 + V9 * 3 - V15) / 8 + 42
+330 LET V5 = (V9 + V4 * 5 - V6) / 11 + 73
+340 LET V9 = (V0 + V12 * 2 - V15) / 6 + 77
+350 LET V9 = (V13 + V2 * 4 - V15) / 8 + 13
+360 LET V14 = (V13 + V2 * 4 - V15) / 10 + 89
+370 LET V4 = (V7 + V5 * 1 - V9) / 6 + 3
+380 LET V14 = (V7 + V12 * 3 - V8) / 8 + 47
+390 LET V14 = (V13 + V4 * 4 - V7) / 8 + 45
+400 LET V6 = (V13 + V9 * 4 - V4) / 9 + 23
+410 LET V5 = (V8 + V2 * 5 - V10) / 9 + 24
+420 LET V15 = (V0 + V4 * 3 - V14) / 6 + 43
+430 LET V0 = (V9 + V14 * 3 - V15) / 6 + 47
+440 LET V3 = (V9 + V14 * 3 - V9) / 8 + 87
+450 LET V1 = (V3 + V1 * 4 - V6) / 8 + 6
+460 LET V11 = (V11 + V4 * 4 - V11) / 9 + 59
+470 LET V4 = (V10 + V0 * 2 - V5) / 8 + 30
+480 LET V11 = (V1 + V12 * 4 - V14) / 9 + 50
+490 LET V1 = (V3 + V6 * 3 - V2) / 8 + 61
+500 LET V3 = (V12 + V10 * 3 - V14) / 9 + 60
+510 LET V3 = (V9 + V3 * 2 - V7) / 5 + 82
+520 LET V7 = (V2 + V2 * 2 - V3) / 8 + 13
+530 LET V15 = (V10 + V10 * 5 - V1) / 8 + 24
+540 LET V4 = (V8 + V13 * 2 - V8) / 7 + 41
+550 LET V11 = (V8 + V0 * 1 - V15) / 4 + 44
+560 LET V4 = (V7 + V4 * 4 - V12) / 8 + 95
+570 LET V14 = (V5 + V1 * 5 - V13) / 10 + 91
+580 LET V12 = (V12 + V2 * 2 - V1) / 5 + 61
+590 LET V9 = (V8 + V0 * 1 - V4) / 4 + 25
+600 LET V2 = (V4 + V11 * 4 - V6) / 10 + 17
+610 LET V5 = (V6 + V2 * 4 - V3) / 7 + 4
+620 LET V11 = (V15 + V15 * 4 - V8) / 7 + 62
+630 LET V15 = (V2 + V3 * 4 - V8) / 8 + 85
+640 LET V12 = (V5 + V1 * 3 - V14) / 9 + 30
+650 LET V4 = (V12 + V7 * 2 - V9) / 7 + 79
+660 LET V15 = (V13 + V13 * 4 - V10) / 10 + 16
+670 LET V7 = (V14 + V12 * 1 - V7) / 4 + 99
+680 LET V11 = (V4 + V13 * 4 - V7) / 10 + 37
+690 LET V2 = (V12 + V10 * 3 - V7) / 6 + 6
+700 LET V12 = (V12 + V13 * 3 - V11) / 8 + 39
+710 LET V5 = (V7 + V8 * 2 - V13) / 6 + 25
+720 LET V7 = (V5 + V4 * 4 - V2) / 7 + 66
+730 LET V4 = (V1 + V0 * 5 - V6) / 10 + 90
+740 LET V7 = (V14 + V15 * 4 - V3) / 10 + 98
+750 LET V4 = (V8 + V6 * 5 - V9) / 11 + 43
+760 LET V6 = (V4 + V11 * 4 - V13) / 10 + 0
+770 LET V5 = (V0 + V10 * 1 - V9) / 6 + 0
+780 LET V15 = (V7 + V14 * 2 - V6) / 8 + 64
+790 LET V0 = (V11 + V10 * 2 - V4) / 5 + 92
+800 LET V3 = (V15 + V5 * 2 - V9) / 5 + 41
+810 LET V14 = (V0 + V6 * 1 - V3) / 4 + 80
+820 LET V2 = (V12 + V13 * 2 - V1) / 7 + 52
+830 LET V9 = (V9 + V2 * 2 - V10) / 8 + 93
+840 LET V8 = (V12 + V13 * 4 - V11) / 7 + 29
+850 LET V0 = (V4 + V11 * 2 - V15) / 5 + 18
+860 LET V5 = (V3 + V15 * 1 - V7) / 7 + 60
+870 LET V4 = (V8 + V2 * 1 - V13) / 5 + 49
+880 LET V6 = (V1 + V6 * 5 - V14) / 9 + 63
+890 LET V10 = (V7 + V14 * 4 - V11) / 9 + 64
+900 LET V0 = (V11 + V13 * 5 - V5) / 11 + 85
+910 LET V15 = (V10 + V7 * 1 - V3) / 6 + 5
+920 LET V4 = (V14 + V8 * 5 - V11) / 11 + 64
+930 LET V14 = (V4 + V4 * 4 - V8) / 7 + 25
+940 LET V8 = (V13 + V14 * 3 - V9) / 8 + 94
+950 LET V8 = (V8 + V12 * 1 - V7) / 5 + 68
+960 LET V5 = (V13 + V11 * 4 - V9) / 8 + 33
+970 LET V11 = (V4 + V15 * 3 - V9) / 7 + 15
+980 LET V4 = (V7 + V6 * 2 - V13) / 6 + 42
+990 LET V14 = (V0 + V5 * 3 - V6) / 6 + 90
+1000 LET V12 = (V7 + V9 * 2 - V1) / 6 + 72
+1010 LET V0 = (V9 + V0 * 5 - V12) / 8 + 39
+1020 LET V7 = (V4 + V8 * 4 - V12) / 10 + 60
+1030 LET V1 = (V4 + V0 * 2 - V15) / 6 + 40
+1040 LET V14 = (V9 + V4 * 1 - V10) / 7 + 77
+1050 LET V4 = (V3 + V7 * 5 - V5) / 10 + 15
+1060 LET V12 = (V9 + V8 * 5 - V3) / 8 + 95
+1070 LET V10 = (V0 + V8 * 2 - V12) / 7 + 73
+1080 LET V9 = (V15 + V2 * 3 - V8) / 7 + 17
+1090 LET V8 = (V5 + V15 * 3 - V13) / 7 + 22
+1100 LET V6 = (V0 + V6 * 4 - V2) / 10 + 37
+1110 LET V8 = (V0 + V5 * 1 - V3) / 7 + 95
+1120 LET V5 = (V7 + V10 * 3 - V15) / 9 + 48
+1130 LET V15 = (V4 + V10 * 3 - V8) / 8 + 37
+1140 LET V2 = (V1 + V9 * 1 - V9) / 7 + 75
+1150 LET V11 = (V14 + V2 * 5 - V3) / 9 + 41
+1160 LET V15 = (V5 + V5 * 5 - V5) / 8 + 30
+1170 LET V4 = (V13 + V12 * 1 - V4) / 5 + 80
+1180 LET V11 = (V1 + V2 * 1 - V14) / 7 + 47
+1190 LET V3 = (V12 + V3 * 4 - V14) / 8 + 13
+1200 LET V8 = (V13 + V8 * 1 - V8) / 7 + 84
+1210 LET V0 = (V15 + V2 * 5 - V5) / 11 + 61
+1220 LET V15 = (V6 + V6 * 3 - V11) / 8 + 59
+1230 LET V10 = (V6 + V1 * 1 - V13) / 5 + 79
+1240 LET V12 = (V10 + V14 * 3 - V5) / 7 + 86
+1250 LET V11 = (V6 + V11 * 2 - V11) / 8 + 7
+1260 LET V3 = (V12 + V11 * 2 - V3) / 5 + 88
+1270 LET V11 = (V11 + V7 * 1 - V5) / 6 + 20
+1280 LET V3 = (V13 + V15 * 3 - V0) / 9 + 37
+1290 LET V0 = (V6 + V3 * 5 - V11) / 11 + 44
+1300 LET V2 = (V13 + V8 * 4 - V6) / 7 + 57
+1310 LET V13 = (V5 + V7 * 1 - V8) / 7 + 87
+1320 LET V1 = (V7 + V1 * 2 - V5) / 5 + 38
+1330 LET V13 = (V15 + V12 * 2 - V13) / 8 + 54
+1340 LET V3 = (V15 + V15 * 4 - V5) / 9 + 76
+1350 LET V6 = (V11 + V5 * 1 - V3) / 7 + 77
+1360 LET V1 = (V12 + V10 * 2 - V3) / 7 + 54
+1370 LET V9 = (V12 + V14 * 5 - V6) / 10 + 25
+1380 LET V3 = (V10 + V12 * 4 - V6) / 10 + 77
+1390 LET V6 = (V4 + V8 * 1 - V12) / 7 + 3
+1400 LET V0 = (V11 + V12 * 3 - V1) / 7 + 29
+1410 LET V11 = (V3 + V13 * 1 - V4) / 7 + 67
+1420 LET V13 = (V7 + V14 * 1 - V0) / 6 + 42
+1430 LET V12 = (V8 + V3 * 4 - V2) / 10 + 96
+1440 LET V12 = (V10 + V15 * 2 - V13) / 8 + 96
+1450 LET V12 = (V4 + V4 * 3 - V7) / 6 + 73
+1460 LET V7 = (V14 + V6 * 2 - V4) / 6 + 31
+1470 LET V7 = (V0 + V11 * 3 - V4) / 9 + 43
+1480 LET V5 = (V11 + V6 * 2 - V2) / 6 + 99
+1490 LET V10 = (V3 + V15 * 3 - V7) / 6 + 93
+1500 LET V15 = (V5 + V10 * 2 - V6) / 5 + 71
+1510 LET V8 = (V6 + V0 * 3 - V0) / 9 + 29
+1520 LET V15 = (V11 + V11 * 3 - V5) / 6 + 48
+1530 LET V12 = (V8 + V7 * 4 - V7) / 8 + 93
+1540 LET V3 = (V10 + V13 * 1 - V2) / 6 + 56
+1550 LET V3 = (V9 + V4 * 1 - V12) / 5 + 82
+1560 LET V7 = (V1 + V1 * 5 - V7) / 11 + 81
+1570 LET V4 = (V15 + V4 * 3 - V1) / 9 + 54
+1580 LET V3 = (V3 + V7 * 5 - V7) / 9 + 59
+1590 LET V14 = (V14 + V2 * 3 - V2) / 7 + 91
+1600 LET V8 = (V12 + V11 * 5 - V15) / 11 + 47
+1610 LET V10 = (V11 + V4 * 4 - V15) / 9 + 3
+1620 LET V3 = (V5 + V9 * 4 - V7) / 7 + 89
+1630 LET V8 = (V6 + V7 * 2 - V6) / 7 + 56
+1640 LET V12 = (V1 + V7 * 5 - V5) / 8 + 33
+1650 LET V10 = (V1 + V12 * 4 - V5) / 7 + 32
+1660 LET V7 = (V10 + V5 * 1 - V10) / 7 + 9
+1670 LET V10 = (V0 + V15 * 3 - V2) / 7 + 57
+1680 LET V11 = (V1 + V2 * 1 - V8) / 6 + 86
+1690 LET V0 = (V13 + V3 * 5 - V10) / 11 + 4
+1700 LET V10 = (V1 + V5 * 4 - V1) / 9 + 77
+1710 LET V12 = (V10 + V14 * 4 - V6) / 10 + 56
+1720 LET V1 = (V5 + V2 * 3 - V13) / 7 + 36
+1730 LET V10 = (V14 + V3 * 4 - V10) / 8 + 34
+1740 LET V9 = (V6 + V6 * 3 - V4) / 8 + 39
+1750 LET V4 = (V7 + V2 * 1 - V0) / 4 + 45
+1760 LET V12 = (V14 + V0 * 2 - V14) / 5 + 73
+1770 LET V11 = (V7 + V1 * 2 - V5) / 6 + 0
+1780 LET V1 = (V11 + V5 * 1 - V11) / 6 + 97
+1790 LET V10 = (V7 + V5 * 5 - V14) / 10 + 94
+1800 LET V1 = (V9 + V6 * 3 - V13) / 7 + 77
+1810 LET V12 = (V9 + V8 * 1 - V7) / 6 + 84
+1820 LET V6 = (V14 + V13 * 4 - V7) / 7 + 15
+1830 LET V13 = (V14 + V2 * 3 - V7) / 8 + 40
+1840 LET V5 = (V0 + V5 * 4 - V6) / 10 + 27
+1850 LET V2 = (V2 + V0 * 4 - V14) / 9 + 42
+1860 LET V12 = (V2 + V4 * 1 - V2) / 4 + 62
+1870 LET V11 = (V5 + V12 * 2 - V9) / 8 + 6
+1880 LET V10 = (V6 + V7 * 3 - V15) / 9 + 40
+1890 LET V1 = (V9 + V10 * 4 - V4) / 9 + 19
+1900 LET V8 = (V4 + V9 * 3 - V4) / 9 + 47
+1910 LET V8 = (V0 + V1 * 2 - V4) / 8 + 87
+1920 LET V9 = (V12 + V15 * 1 - V3) / 5 + 22
+1930 LET V10 = (V3 + V10 * 5 - V12) / 9 + 1
+1940 LET V9 = (V0 + V3 * 2 - V1) / 8 + 41
+1950 LET V12 = (V11 + V14 * 4 - V5) / 10 + 65
+1960 LET V0 = (V13 + V8 * 4 - V9) / 8 + 84
+1970 LET V13 = (V13 + V1 * 1 - V8) / 6 + 25
+1980 LET V15 = (V15 + V4 * 1 - V8) / 5 + 65
+1990 LET V6 = (V5 + V1 * 1 - V3) / 7 + 55
+2000 LET V12 = (V15 + V3 * 5 - V13) / 10 + 43
+2010 LET V7 = (V2 + V4 * 1 - V5) / 5 + 82
+2020 LET V2 = (V0 + V1 * 1 - V2) / 5 + 67
+2030 LET V1 = (V13 + V5 * 1 - V7) / 5 + 65
+2040 LET V2 = (V5 + V3 * 2 - V15) / 6 + 75
+2050 LET V2 = (V2 + V3 * 2 - V9) / 6 + 93
+2060 LET V6 = (V13 + V12 * 5 - V9) / 11 + 69
+2070 LET V13 = (V2 + V5 * 1 - V15) / 6 + 39
+2080 LET V2 = (V1 + V0 * 3 - V5) / 7 + 25
+2090 LET V12 = (V10 + V0 * 5 - V15) / 8 + 54
+2100 LET V2 = (V10 + V7 * 3 - V8) / 7 + 10
+2110 LET V5 = (V1 + V12 * 2 - V3) / 5 + 13
+2120 LET V4 = (V14 + V8 * 5 - V6) / 10 + 74
+2130 LET V7 = (V13 + V15 * 3 - V4) / 6 + 21
+2140 LET V5 = (V3 + V12 * 5 - V8) / 9 + 6
+2150 LET V6 = (V8 + V2 * 3 - V11) / 9 + 91
+2160 LET V14 = (V2 + V0 * 1 - V2) / 6 + 59
+2170 LET V0 = (V3 + V5 * 1 - V8) / 5 + 78
+2180 LET V9 = (V5 + V0 * 3 - V15) / 9 + 49
+2190 LET V7 = (V0 + V8 * 3 - V13) / 8 + 53
+2200 LET V2 = (V11 + V7 * 5 - V0) / 10 + 16
+2210 LET V14 = (V1 + V12 * 2 - V14) / 5 + 41
+2220 LET V5 = (V6 + V3 * 4 - V15) / 7 + 90
+2230 LET V4 = (V15 + V6 * 1 - V11) / 7 + 56
+2240 LET V8 = (V11 + V1 * 3 - V10) / 8 + 66
+2250 LET V4 = (V1 + V13 * 1 - V2) / 6 + 6
+2260 LET V7 = (V11 + V7 * 1 - V12) / 6 + 74
+2270 LET V13 = (V14 + V10 * 5 - V2) / 8 + 91
+2280 LET V14 = (V0 + V7 * 4 - V6) / 9 + 7
+2290 LET V1 = (V2 + V11 * 1 - V5) / 6 + 51
+2300 LET V5 = (V2 + V9 * 5 - V13) / 8 + 62
+2310 LET V15 = (V11 + V6 * 4 - V13) / 7 + 0
+2320 LET V8 = (V1 + V14 * 1 - V6) / 5 + 80
+2330 LET V12 = (V15 + V14 * 1 - V14) / 6 + 27
+2340 LET V4 = (V3 + V12 * 2 - V10) / 6 + 47
+2350 LET V3 = (V6 + V1 * 1 - V3) / 5 + 3
+2360 LET V12 = (V8 + V0 * 3 - V5) / 9 + 70
+2370 LET V10 = (V5 + V8 * 2 - V7) / 6 + 40
+2380 LET V6 = (V0 + V10 * 2 - V11) / 6 + 33
+2390 LET V8 = (V13 + V12 * 2 - V12) / 8 + 97
+2400 LET V6 = (V6 + V0 * 5 - V3) / 8 + 55
+2410 LET V7 = (V0 + V4 * 2 - V2) / 8 + 66
+2420 LET V10 = (V2 + V1 * 1 - V1) / 7 + 76
+2430 LET V6 = (V3 + V1 * 1 - V15) / 7 + 72
+2440 LET V5 = (V13 + V11 * 2 - V12) / 7 + 1
+2450 LET V1 = (V12 + V9 * 4 - V9) / 10 + 76
+2460 LET V1 = (V9 + V6 * 4 - V12) / 8 + 83
+2470 LET V15 = (V3 + V9 * 3 - V5) / 8 + 26
+2480 LET V8 = (V9 + V15 * 3 - V14) / 8 + 67
+2490 LET V10 = (V6 + V11 * 1 - V12) / 5 + 34
+2500 LET V14 = (V1 + V1 * 4 - V0) / 9 + 77
+2510 LET V7 = (V0 + V9 * 2 - V6) / 5 + 73
+2520 LET V12 = (V14 + V15 * 3 - V5) / 9 + 21
+2530 LET V15 = (V10 + V14 * 1 - V9) / 6 + 35
+2540 LET V3 = (V13 + V11 * 5 - V1) / 11 + 11
+2550 LET V9 = (V5 + V14 * 2 - V1) / 7 + 48
+2560 LET V10 = (V11 + V3 * 4 - V6) / 7 + 75
+2570 LET V2 = (V3 + V15 * 5 - V1) / 11 + 69
+2580 LET V14 = (V7 + V0 * 2 - V2) / 7 + 25
+2590 LET V3 = (V8 + V6 * 5 - V13) / 9 + 92
+2600 LET V4 = (V12 + V6 * 3 - V15) / 8 + 38
+2610 LET V2 = (V13 + V2 * 1 - V4) / 4 + 38
+2620 LET V14 = (V15 + V1 * 3 - V13) / 6 + 98
+2630 LET V11 = (V14 + V3 * 3 - V15) / 8 + 82
+2640 LET V5 = (V14 + V12 * 4 - V10) / 7 + 59
+2650 LET V2 = (V12 + V15 * 4 - V5) / 7 + 61
+2660 LET V10 = (V3 + V0 * 2 - V9) / 5 + 40
+2670 LET V10 = (V3 + V6 * 1 - V6) / 6 + 36
+2680 LET V9 = (V4 + V3 * 1 - V14) / 7 + 55
+2690 LET V13 = (V1 + V2 * 5 - V0) / 8 + 35
+2700 LET V8 = (V3 + V15 * 3 - V3) / 9 + 76
+2710 LET V10 = (V1 + V2 * 2 - V5) / 7 + 71
+2720 LET V6 = (V3 + V1 * 3 - V15) / 7 + 90
+2730 LET V10 = (V3 + V7 * 2 - V7) / 7 + 52
+2740 LET V3 = (V11 + V14 * 5 - V12) / 11 + 97
+2750 LET V7 = (V13 + V11 * 5 - V1) / 11 + 44
+2760 LET V3 = (V7 + V2 * 4 - V10) / 7 + 62
+2770 LET V2 = (V8 + V8 * 4 - V13) / 10 + 31
+2780 LET V1 = (V9 + V13 * 2 - V5) / 7 + 9
+2790 LET V5 = (V9 + V1 * 3 - V12) / 9 + 88
+2800 LET V5 = (V11 + V5 * 2 - V8) / 6 + 17
+2810 LET V14 = (V11 + V12 * 2 - V1) / 6 + 90
+2820 LET V15 = (V5 + V3 * 5 - V0) / 8 + 34
+2830 LET V4 = (V12 + V7 * 2 - V9) / 7 + 34
+2840 LET V13 = (V5 + V3 * 1 - V2) / 6 + 70
+2850 LET V4 = (V0 + V14 * 4 - V2) / 9 + 26
+2860 LET V15 = (V0 + V2 * 2 - V15) / 6 + 97
+2870 LET V4 = (V7 + V5 * 2 - V8) / 8 + 13
+2880 LET V10 = (V4 + V7 * 4 - V7) / 9 + 64
+2890 LET V10 = (V3 + V5 * 2 - V15) / 5 + 14
+2900 LET V0 = (V14 + V6 * 5 - V0) / 10 + 0
+2910 LET V4 = (V15 + V15 * 3 - V8) / 7 + 10
+2920 LET V11 = (V0 + V3 * 2 - V5) / 7 + 84
+2930 LET V15 = (V6 + V7 * 4 - V10) / 10 + 59
+2940 LET V15 = (V1 + V11 * 1 - V0) / 4 + 5
+2950 LET V15 = (V11 + V0 * 4 - V3) / 7 + 80
+2960 LET V2 = (V5 + V14 * 3 - V14) / 6 + 24
+2970 LET V11 = (V13 + V1 * 2 - V11) / 7 + 32
+2980 LET V15 = (V7 + V14 * 3 - V14) / 8 + 91
+2990 LET V9 = (V13 + V15 * 3 - V8) / 6 + 77
+3000 LET V4 = (V0 + V9 * 3 - V7) / 8 + 35
+3010 LET V12 = (V10 + V9 * 3 - V8) / 8 + 24
+3020 LET V13 = (V4 + V9 * 4 - V12) / 9 + 67
+3030 LET V4 = (V2 + V9 * 5 - V13) / 10 + 34
+3040 LET V8 = (V9 + V2 * 4 - V13) / 9 + 33
+3050 LET V0 = (V3 + V11 * 5 - V13) / 9 + 38
+3060 LET V6 = (V15 + V10 * 2 - V3) / 5 + 98
+3070 LET V15 = (V11 + V10 * 5 - V3) / 8 + 3
+3080 LET V13 = (V12 + V6 * 2 - V6) / 7 + 29
+3090 LET V15 = (V3 + V10 * 3 - V0) / 7 + 84
+3100 LET V4 = (V9 + V3 * 3 - V11) / 9 + 93
+3110 LET V13 = (V1 + V14 * 4 - V13) / 9 + 3
+3120 LET V10 = (V13 + V1 * 4 - V8) / 8 + 96
+3130 LET V15 = (V15 + V4 * 1 - V14) / 7 + 94
+3140 LET V9 = (V3 + V12 * 5 - V14) / 8 + 64
+3150 LET V6 = (V14 + V9 * 5 - V4) / 9 + 8
+3160 LET V12 = (V1 + V1 * 5 - V6) / 8 + 95
+3170 LET V7 = (V10 + V14 * 4 - V6) / 7 + 37
+3180 LET V13 = (V0 + V5 * 2 - V6) / 5 + 36
+3190 LET V1 = (V2 + V0 * 1 - V7) / 6 + 74
+3200 LET V15 = (V1 + V13 * 1 - V11) / 7 + 16
+3210 LET V0 = (V2 + V1 * 5 - V8) / 8 + 95
+3220 LET V7 = (V3 + V5 * 2 - V4) / 7 + 68
+3230 LET V7 = (V11 + V0 * 5 - V8) / 8 + 2
+3240 LET V14 = (V10 + V12 * 4 - V14) / 9 + 63
+3250 LET V14 = (V8 + V12 * 4 - V14) / 10 + 43
+3260 LET V8 = (V15 + V6 * 1 - V15) / 6 + 21
+3270 LET V6 = (V5 + V14 * 1 - V13) / 7 + 41
+3280 LET V15 = (V0 + V7 * 4 - V14) / 7 + 76
+3290 LET V7 = (V13 + V6 * 2 - V5) / 5 + 26
+3300 LET V1 = (V2 + V11 * 1 - V9) / 4 + 57
+3310 LET V3 = (V12 + V12 * 1 - V9) / 6 + 46
+3320 LET V4 = (V10 + V14 * 4 - V3) / 8 + 10
+3330 LET V6 = (V8 + V14 * 2 - V13) / 6 + 19
+3340 LET V11 = (V7 + V7 * 4 - V13) / 7 + 43
+3350 LET V11 = (V4 + V0 * 1 - V14) / 7 + 52
+3360 LET V3 = (V8 + V15 * 1 - V7) / 7 + 71
+3370 LET V14 = (V3 + V13 * 4 - V5) / 9 + 16
+3380 LET V1 = (V15 + V5 * 3 - V13) / 9 + 65
+3390 LET V1 = (V15 + V1 * 2 - V12) / 5 + 71
+3400 LET V5 = (V14 + V3 * 3 - V8) / 6 + 2
+3410 LET V10 = (V1 + V11 * 2 - V8) / 7 + 84
+3420 LET V0 = (V4 + V0 * 2 - V2) / 6 + 95
+3430 LET V11 = (V3 + V9 * 1 - V12) / 6 + 59
+3440 LET V7 = (V12 + V5 * 4 - V12) / 9 + 30
+3450 LET V2 = (V12 + V5 * 5 - V12) / 8 + 31
+3460 LET V2 = (V9 + V2 * 5 - V3) / 8 + 34
+3470 LET V1 = (V8 + V4 * 4 - V12) / 10 + 59
+3480 LET V15 = (V9 + V3 * 3 - V6) / 8 + 14
+3490 LET V1 = (V1 + V7 * 5 - V4) / 11 + 5
+3500 LET V11 = (V13 + V5 * 3 - V14) / 8 + 14
+3510 LET V5 = (V11 + V7 * 2 - V7) / 8 + 25
+3520 LET V0 = (V11 + V13 * 2 - V15) / 5 + 36
+3530 LET V11 = (V8 + V8 * 4 - V13) / 10 + 8
+3540 LET V7 = (V11 + V2 * 3 - V3) / 8 + 14
+3550 LET V0 = (V0 + V4 * 4 - V6) / 10 + 85
+3560 LET V0 = (V8 + V1 * 2 - V0) / 8 + 99
+3570 LET V8 = (V0 + V5 * 3 - V4) / 9 + 6
+3580 LET V2 = (V13 + V2 * 3 - V10) / 7 + 87
+3590 LET V2 = (V12 + V0 * 5 - V3) / 9 + 62
+3600 LET V8 = (V1 + V7 * 4 - V8) / 9 + 58
+3610 LET V14 = (V8 + V9 * 3 - V7) / 9 + 71
+3620 LET V2 = (V13 + V12 * 4 - V5) / 10 + 98
+3630 LET V3 = (V3 + V13 * 1 - V6) / 7 + 59
+3640 LET V13 = (V3 + V3 * 2 - V6) / 7 + 96
+3650 LET V15 = (V4 + V8 * 5 - V13) / 8 + 31
+3660 LET V6 = (V1 + V0 * 5 - V9) / 11 + 88
+3670 LET V8 = (V12 + V13 * 5 - V12) / 10 + 13
+3680 LET V0 = (V9 + V11 * 5 - V13) / 11 + 24
+3690 LET V1 = (V10 + V3 * 5 - V0) / 11 + 89
+3700 LET V13 = (V14 + V3 * 5 - V4) / 8 + 82
+3710 LET V13 = (V1 + V11 * 5 - V6) / 10 + 17
+3720 LET V13 = (V4 + V4 * 5 - V13) / 8 + 67
+3730 LET V11 = (V0 + V14 * 4 - V12) / 7 + 85
+3740 LET V10 = (V14 + V11 * 4 - V7) / 10 + 73
+3750 LET V11 = (V3 + V8 * 2 - V9) / 6 + 2
+3760 LET V1 = (V13 + V3 * 1 - V14) / 6 + 76
+3770 LET V0 = (V8 + V7 * 3 - V12) / 7 + 56
+3780 LET V3 = (V8 + V6 * 2 - V13) / 5 + 33
+3790 LET V2 = (V2 + V1 * 2 - V14) / 7 + 54
+3800 LET V10 = (V14 + V9 * 4 - V11) / 10 + 67
+3810 LET V14 = (V4 + V7 * 5 - V15) / 11 + 70
+3820 LET V6 = (V4 + V4 * 4 - V9) / 9 + 48
+3830 LET V2 = (V13 + V13 * 5 - V5) / 11 + 26
+3840 LET V5 = (V8 + V12 * 3 - V15) / 7 + 71
+3850 LET V2 = (V2 + V6 * 3 - V1) / 9 + 2
+3860 LET V3 = (V11 + V11 * 5 - V9) / 8 + 23
+3870 LET V11 = (V11 + V11 * 3 - V13) / 8 + 20
+3880 LET V9 = (V6 + V7 * 5 - V14) / 9 + 88
+3890 LET V6 = (V10 + V9 * 4 - V9) / 10 + 66
+3900 LET V3 = (V12 + V11 * 3 - V6) / 7 + 3
+3910 LET V7 = (V6 + V4 * 1 - V2) / 7 + 4
+3920 LET V11 = (V8 + V4 * 5 - V4) / 10 + 18
+3930 LET V14 = (V15 + V1 * 4 - V5) / 9 + 90
+3940 LET V6 = (V10 + V9 * 3 - V9) / 7 + 2
+3950 LET V15 = (V11 + V1 * 1 - V6) / 5 + 58
+3960 LET V4 = (V5 + V10 * 5 - V15) / 11 + 25
+3970 LET V13 = (V9 + V7 * 3 - V12) / 8 + 8
+3980 LET V3 = (V2 + V15 * 5 - V10) / 10 + 25
+3990 LET V3 = (V13 + V4 * 3 - V2) / 7 + 59
+4000 LET V10 = (V11 + V2 * 1 - V14) / 7 + 87
+4010 LET V14 = (V11 + V2 * 2 - V11) / 7 + 47
+4020 LET V14 = (V1 + V8 * 2 - V2) / 7 + 77
+4030 LET V0 = (V1 + V0 * 5 - V4) / 9 + 47
+4040 LET V7 = (V10 + V1 * 2 - V1) / 6 + 99
+4050 LET V6 = (V1 + V13 * 4 - V4) / 7 + 98
+4060 LET V1 = (V9 + V7 * 4 - V15) / 7 + 10
+4070 LET V14 = (V8 + V14 * 4 - V14) / 10 + 22
+4080 LET V9 = (V3 + V11 * 5 - V1) / 11 + 16
+4090 LET V4 = (V0 + V2 * 1 - V10) / 4 + 91
+5000 LET I = I + 1
+5010 IF I < N THEN 100
+5020 PRINT V0
+5025 PRINT V5
+5030 PRINT V10
+5035 PRINT V15
+5100 END
+RUN
+10000
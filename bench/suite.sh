@@ -0,0 +1,74 @@
+#!/bin/bash
+# Run the corpus in bench/ (or the given programs) under each engine, and
+# report the median time of $REPEAT runs after $WARMUP warm-up runs, and the
+# instructions of binary code run per second. All runs of a program and an
+# engine are in one process, so warm-up runs also fill the caches of the
+# engines, and times are those of STATS, i.e. of the run alone.
+#
+# Programs are as for engines.sh: BASIC lines, then RUN, then their input.
+#
+# Results go to stdout as CSV:
+#	program,engine,median_s,steps,steps_per_s[,vs_baseline]
+# where steps are counted once under SWITCH, as other engines run the same
+# binary code. If $BASELINE (bench/baseline.csv by default) holds results
+# of an earlier run, vs_baseline is the median over that of the baseline,
+# so that above 1 is slower.
+#
+# usage: bench/suite.sh [program.bas...]
+# The binary must be built with -DNOT_LAB2_JUDGE, as `make bench` does.
+
+BIN=${BIN:-./basic-lab2}
+ENGINES=${ENGINES:-"SWITCH THREADED COMPACT JIT CLOSURE TRACE"}
+WARMUP=${WARMUP:-2}
+REPEAT=${REPEAT:-5}
+BASELINE=${BASELINE:-"$(dirname "$0")/baseline.csv"}
+
+[ $# -gt 0 ] || set -- "$(dirname "$0")"/*.bas
+
+# Feed program $2 to the console under engine $1, to run $3 times with
+# STATS after each, and print the figure $4 of each run.
+runs() {
+	{
+		echo "STATS ON"
+		echo "ENGINE $1"
+		sed '/^RUN$/,$d' "$2"
+		for ((i = 0; i < $3; ++i)); do
+			sed -n '/^RUN$/,$p' "$2"
+			echo STATS
+		done
+	} | "$BIN" | awk -v name="$4" '
+		index($0, name " ") == 1 { print $NF == "S" ? $(NF - 1) : $NF }'
+}
+
+median() {
+	sort -g | awk '{ t[NR] = $1 } END {
+		print NR % 2 ? t[(NR + 1) / 2] : (t[NR / 2] + t[NR / 2 + 1]) / 2 }'
+}
+
+baseline() {
+	[ -f "$BASELINE" ] && awk -F, -v p="$1" -v e="$2" \
+		'$1 == p && $2 == e { print $3 }' "$BASELINE"
+}
+
+header=program,engine,median_s,steps,steps_per_s
+[ -f "$BASELINE" ] && header=$header,vs_baseline
+echo "$header"
+for prog in "$@"; do
+	name=$(basename "$prog" .bas)
+	steps=$(runs SWITCH "$prog" 1 STEPS)
+	for engine in $ENGINES; do
+		if [ "$("$BIN" <<< "ENGINE $engine")" = "ENGINE NOT AVAILABLE" ]; then
+			continue
+		fi
+		t=$(runs "$engine" "$prog" $((WARMUP + REPEAT)) TIME |
+			tail -n "$REPEAT" | median)
+		row="$name,$engine,$t,$steps,$(awk "BEGIN { printf \"%.0f\", $steps / $t }")"
+		if [ -f "$BASELINE" ]; then
+			base=$(baseline "$name" "$engine")
+			row="$row,"
+			[ -z "$base" ] ||
+				row="$row$(awk "BEGIN { printf \"%.3f\", $t / $base }")"
+		fi
+		echo "$row"
+	done
+done
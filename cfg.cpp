@@ -0,0 +1,295 @@
+#include "cfg.hpp"
+
+namespace BASIC {
+
+namespace {
+
+bool is_jump(const command& comm)
+{
+	return comm.type == command::BASIC_GOTO || comm.type == command::BASIC_IF;
+}
+
+// The expressions of a line, in the order linker::if_condition() evaluates
+// them.
+std::array<const expr_t*, 2> exprs_of(const command& comm)
+{
+	switch (comm.type) {
+	case command::BASIC_LET:
+	case command::BASIC_PRINT:
+		return {&comm.expr, nullptr};
+	case command::BASIC_IF:
+		if (comm.cmp == "<")
+			return {&comm.expr2, &comm.expr};
+		return {&comm.expr, &comm.expr2};
+	default:
+		return {nullptr, nullptr};
+	}
+}
+
+} // namespace
+
+control_flow_graph::control_flow_graph(object_code_t& obj,
+		const line_notes_t* notes):
+	_obj(obj),
+	_notes(notes)
+{
+	std::vector<object_code_t::iterator> lines;
+	std::vector<std::size_t> linenos;
+	for (auto it = obj.begin(); it != obj.end(); ++it) {
+		lines.push_back(it);
+		linenos.push_back(it->first);
+		add_vars(it->second);
+		if (auto n = notes_of(it->first)) {
+			for (auto& h : n->hoisted)
+				add_vars(h);
+			if (n->count) {
+				add_var(n->count->count);
+				add_var(n->count->triangle);
+			}
+		}
+	}
+	_visible = empty_set();
+	for (std::size_t i = 0; i < _names.size(); ++i)
+		if (_names[i][0] != '~')
+			_visible.set(i);
+
+	// index of the line a jump goes to, or lines.size() if it is missing
+	auto target_of = [&linenos](const command& comm) {
+		auto t = std::lower_bound(linenos.begin(), linenos.end(),
+			comm.target_lineno);
+		if (t == linenos.end() || *t != comm.target_lineno)
+			return linenos.size();
+		return static_cast<std::size_t>(t - linenos.begin());
+	};
+	std::vector<bool> leader(lines.size() + 1);
+	leader[0] = true;
+	for (std::size_t i = 0; i < lines.size(); ++i) {
+		auto& a = lines[i]->second;
+		if (is_jump(a))
+			leader[target_of(a)] = true;
+		if (is_jump(a) || a.type == command::BASIC_END)
+			leader[i + 1] = true;
+	}
+	std::vector<std::size_t> block_of(lines.size());
+	for (std::size_t i = 0; i < lines.size(); ++i) {
+		if (leader[i])
+			_blocks.emplace_back();
+		block_of[i] = _blocks.size() - 1;
+		_blocks.back().lines.push_back(lines[i]);
+	}
+	auto n = _blocks.size();
+	for (std::size_t b = 0; b < n; ++b) {
+		auto& blk = _blocks[b];
+		auto& a = blk.lines.back()->second;
+		bool falls = a.type != command::BASIC_GOTO;
+		if (is_jump(a)) {
+			auto t = target_of(a);
+			if (t < lines.size())
+				blk.succs.push_back(block_of[t]);
+			else
+				// INT, which traps however the condition is
+				falls = false;
+		}
+		if (falls && b + 1 < n && (blk.succs.empty() ||
+				blk.succs[0] != b + 1))
+			blk.succs.push_back(b + 1);
+		else if (falls && b + 1 == n)
+			blk.exit = true;
+		for (auto s : blk.succs)
+			_blocks[s].preds.push_back(b);
+	}
+}
+
+const line_notes* control_flow_graph::notes_of(std::size_t lineno) const
+{
+	if (!_notes)
+		return nullptr;
+	auto it = _notes->find(lineno);
+	return it == _notes->end() ? nullptr : &it->second;
+}
+
+void control_flow_graph::add_var(const std::string& name)
+{
+	if (_vars.emplace(name, _names.size()).second)
+		_names.push_back(name);
+}
+
+void control_flow_graph::add_vars(const command& comm)
+{
+	for (auto expr : {&comm.expr, &comm.expr2})
+		for (auto& token : *expr)
+			if (token.type == expr_token::VARIABLE ||
+					token.type == expr_token::SAVE)
+				add_var(token.str);
+	if (comm.type == command::BASIC_LET || comm.type == command::BASIC_INPUT)
+		add_var(comm.target_var);
+}
+
+// Hoisted LETs run first, and then the loop count, which reads the
+// difference a hoisted LET assigns.
+void control_flow_graph::effects(const object_code_t::value_type& line,
+	std::vector<std::size_t>& reads, std::vector<std::size_t>& writes) const
+{
+	reads.clear();
+	writes.clear();
+	if (auto n = notes_of(line.first)) {
+		for (auto& h : n->hoisted)
+			add_effects(h, reads, writes);
+		if (n->count) {
+			writes.push_back(var(n->count->count));
+			writes.push_back(var(n->count->triangle));
+		}
+	}
+	add_effects(line.second, reads, writes);
+}
+
+void control_flow_graph::add_effects(const command& comm,
+	std::vector<std::size_t>& reads, std::vector<std::size_t>& writes) const
+{
+	for (auto expr : exprs_of(comm)) {
+		if (!expr)
+			continue;
+		for (auto& token : *expr) {
+			if (token.type == expr_token::SAVE)
+				writes.push_back(var(token.str));
+			// hidden variables saved before in the line are not
+			// read from before it
+			if (token.type == expr_token::VARIABLE &&
+					std::find(writes.begin(), writes.end(),
+					var(token.str)) == writes.end())
+				reads.push_back(var(token.str));
+		}
+	}
+	if (comm.type == command::BASIC_LET || comm.type == command::BASIC_INPUT)
+		writes.push_back(var(comm.target_var));
+}
+
+// Reading a variable traps unless it is defined, and so does a division,
+// unless by a constant other than 0, or -1, which overflows.
+bool control_flow_graph::may_stop(const object_code_t::value_type& line,
+	const var_set& defined) const
+{
+	static const std::vector<command> none;
+	auto& comm = line.second;
+	auto n = notes_of(line.first);
+	auto& hoisted = n ? n->hoisted : none;
+	switch (comm.type) {
+	case command::BASIC_INPUT:
+	case command::BASIC_END:
+		return true;
+	case command::BASIC_GOTO:
+	case command::BASIC_IF:
+		if (!_obj.count(comm.target_lineno))
+			return true;
+		break;
+	default:
+		break;
+	}
+	std::vector<const expr_t*> exprs;
+	for (auto& h : hoisted)
+		exprs.push_back(&h.expr);
+	for (auto expr : exprs_of(comm))
+		if (expr)
+			exprs.push_back(expr);
+	// hidden variables that hoisted LETs and SAVEs assign before
+	std::vector<std::size_t> saved;
+	for (auto& h : hoisted)
+		saved.push_back(var(h.target_var));
+	for (auto expr : exprs) {
+		for (std::size_t i = 0; i < expr->size(); ++i) {
+			auto& token = (*expr)[i];
+			if (token.type == expr_token::SAVE) {
+				saved.push_back(var(token.str));
+			} else if (token.type == expr_token::VARIABLE) {
+				auto v = var(token.str);
+				if (!defined.test(v) && std::find(saved.begin(),
+						saved.end(), v) == saved.end())
+					return true;
+			} else if (token.type == expr_token::OPERATOR &&
+					token.str[0] == '/') {
+				auto& b = (*expr)[i - 1];
+				if (b.type != expr_token::IMMEDIATE ||
+						b.num == 0 || b.num == -1)
+					return true;
+			}
+		}
+	}
+	return false;
+}
+
+void control_flow_graph::defined_after(const object_code_t::value_type& line,
+	var_set& defined) const
+{
+	std::vector<std::size_t> reads, writes;
+	effects(line, reads, writes);
+	for (auto v : writes)
+		defined.set(v);
+}
+
+// If it stops, the program may do so before its writes.
+void control_flow_graph::live_before(const object_code_t::value_type& line,
+	bool stops, var_set& live) const
+{
+	std::vector<std::size_t> reads, writes;
+	effects(line, reads, writes);
+	for (auto v : writes)
+		live.reset(v);
+	for (auto v : reads)
+		live.set(v);
+	if (stops)
+		live.unite(_visible);
+}
+
+// A block only adds what its lines assign.
+std::vector<var_set> control_flow_graph::defined() const
+{
+	std::vector<var_set> assigned(_blocks.size(), empty_set());
+	for (std::size_t b = 0; b < _blocks.size(); ++b)
+		for (auto line : _blocks[b].lines)
+			defined_after(*line, assigned[b]);
+	return solve(FORWARD, INTERSECTION, empty_set(),
+		[&assigned](std::size_t b, var_set s) {
+			s.unite(assigned[b]);
+			return s;
+		});
+}
+
+// Through a block, the live set loses the variables of kill and gains those
+// of gen, which are found line by line backwards: a line that assigns W and
+// reads R, or may stop, turns (x - kill) | gen into
+// (x - (kill | W)) | (gen - W) | R, with the visible variables too.
+std::vector<var_set> control_flow_graph::live(
+	const std::vector<var_set>& defined) const
+{
+	std::vector<var_set> kill(_blocks.size(), empty_set());
+	std::vector<var_set> gen(_blocks.size(), empty_set());
+	std::vector<std::size_t> reads, writes;
+	for (std::size_t b = 0; b < _blocks.size(); ++b) {
+		auto& lines = _blocks[b].lines;
+		std::vector<bool> stops(lines.size());
+		auto d = defined[b];
+		for (std::size_t i = 0; i < lines.size(); ++i) {
+			stops[i] = may_stop(*lines[i], d);
+			defined_after(*lines[i], d);
+		}
+		for (std::size_t i = lines.size(); i-- > 0; ) {
+			effects(*lines[i], reads, writes);
+			for (auto v : writes) {
+				kill[b].set(v);
+				gen[b].reset(v);
+			}
+			for (auto v : reads)
+				gen[b].set(v);
+			if (stops[i])
+				gen[b].unite(_visible);
+		}
+	}
+	return solve(BACKWARD, UNION, _visible,
+		[&kill, &gen](std::size_t b, var_set s) {
+			s.subtract(kill[b]);
+			s.unite(gen[b]);
+			return s;
+		});
+}
+
+} // namespace BASIC
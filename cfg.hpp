@@ -0,0 +1,210 @@
+#ifndef BASIC_CFG_HPP
+#define BASIC_CFG_HPP
+
+#include "common.hpp"
+
+#include "command.hpp"
+#include "optimizer.hpp"
+
+namespace BASIC {
+
+// A set of the variables of a control_flow_graph, by index.
+class var_set {
+public:
+	var_set() = default;
+	var_set(std::size_t n, bool full):
+		words((n + 63) / 64, full ? ~std::uint64_t(0) : 0)
+	{ }
+	bool test(std::size_t i) const
+	{
+		return words[i / 64] >> (i % 64) & 1;
+	}
+	void set(std::size_t i)
+	{
+		words[i / 64] |= std::uint64_t(1) << (i % 64);
+	}
+	void reset(std::size_t i)
+	{
+		words[i / 64] &= ~(std::uint64_t(1) << (i % 64));
+	}
+	// *this |= other, and whether that changed it
+	bool unite(const var_set& other)
+	{
+		bool changed = false;
+		for (std::size_t i = 0; i < words.size(); ++i) {
+			auto w = words[i] | other.words[i];
+			changed |= w != words[i];
+			words[i] = w;
+		}
+		return changed;
+	}
+	// *this &= ~other
+	void subtract(const var_set& other)
+	{
+		for (std::size_t i = 0; i < words.size(); ++i)
+			words[i] &= ~other.words[i];
+	}
+	// *this &= other, and whether that changed it
+	bool intersect(const var_set& other)
+	{
+		bool changed = false;
+		for (std::size_t i = 0; i < words.size(); ++i) {
+			auto w = words[i] & other.words[i];
+			changed |= w != words[i];
+			words[i] = w;
+		}
+		return changed;
+	}
+	bool operator==(const var_set& other) const
+	{
+		return words == other.words;
+	}
+	bool operator!=(const var_set& other) const
+	{
+		return words != other.words;
+	}
+
+private:
+	std::vector<std::uint64_t> words;
+};
+
+// The lines of object code in basic blocks, for dataflow over its variables.
+// Blocks start at the first line, at lines that GOTO or IF may jump to, and
+// after GOTO, IF and END, and are in the order of their lines, so block 0 is
+// where the program starts. END falls through to the next block, where CONT
+// goes on.
+//
+// The program may stop at END, where it runs off the end, and wherever a
+// line may trap or wait for input, and then every variable but the hidden
+// ones may be looked at. So they are all live there.
+class control_flow_graph {
+public:
+	struct block {
+		// lines in order
+		std::vector<object_code_t::iterator> lines;
+		std::vector<std::size_t> succs;
+		std::vector<std::size_t> preds;
+		// whether the program may run off the end after it
+		bool exit = false;
+	};
+	enum direction {
+		FORWARD,
+		BACKWARD,
+	};
+	enum meet_type {
+		UNION,
+		INTERSECTION,
+	};
+
+	// With the notes of the passes that ran on obj, if any.
+	explicit control_flow_graph(object_code_t& obj,
+		const line_notes_t* notes = nullptr);
+	const std::vector<block>& blocks() const
+	{
+		return _blocks;
+	}
+	std::size_t nvars() const
+	{
+		return _names.size();
+	}
+	// index of a variable that the program names
+	std::size_t var(const std::string& name) const
+	{
+		return _vars.at(name);
+	}
+	var_set empty_set() const
+	{
+		return var_set(nvars(), false);
+	}
+	// variables that are not hidden
+	const var_set& visible() const
+	{
+		return _visible;
+	}
+
+	// Variables that a line reads before assigning them, and those it
+	// assigns, in the order it evaluates its expressions, its hoisted LETs
+	// first.
+	void effects(const object_code_t::value_type& line,
+		std::vector<std::size_t>& reads,
+		std::vector<std::size_t>& writes) const;
+	// Whether the program may stop at a line, with the variables known to
+	// be defined before it.
+	bool may_stop(const object_code_t::value_type& line,
+		const var_set& defined) const;
+	// through a line, forwards or backwards
+	void defined_after(const object_code_t::value_type& line,
+		var_set& defined) const;
+	void live_before(const object_code_t::value_type& line, bool stops,
+		var_set& live) const;
+
+	// Solve a dataflow problem over sets of variables. transfer(b, s) takes
+	// the set where flow enters block b, its start for FORWARD and its end
+	// for BACKWARD, and returns the one where flow leaves it. At the start
+	// of the program for FORWARD, or at the end of exit blocks for
+	// BACKWARD, the set flowing in also meets boundary. Return the sets
+	// where flow enters each block.
+	template<class Transfer>
+	std::vector<var_set> solve(direction dir, meet_type meet,
+		const var_set& boundary, Transfer transfer) const;
+	// variables defined on every path to the start of each block
+	std::vector<var_set> defined() const;
+	// variables live at the end of each block, with those of defined()
+	std::vector<var_set> live(const std::vector<var_set>& defined) const;
+
+private:
+	const object_code_t& _obj;
+	const line_notes_t* _notes;
+	std::vector<block> _blocks;
+	std::unordered_map<std::string, std::size_t> _vars;
+	std::vector<std::string> _names;
+	var_set _visible;
+
+	// the notes of a line, or null
+	const line_notes* notes_of(std::size_t lineno) const;
+	void add_var(const std::string& name);
+	void add_vars(const command& comm);
+	void add_effects(const command& comm, std::vector<std::size_t>& reads,
+		std::vector<std::size_t>& writes) const;
+};
+
+template<class Transfer>
+std::vector<var_set> control_flow_graph::solve(direction dir, meet_type meet,
+	const var_set& boundary, Transfer transfer) const
+{
+	auto n = _blocks.size();
+	var_set top(nvars(), meet == INTERSECTION);
+	std::vector<var_set> in(n, top);
+	std::vector<var_set> out(n, top);
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for (std::size_t k = 0; k < n; ++k) {
+			auto b = dir == FORWARD ? k : n - 1 - k;
+			auto& from = dir == FORWARD ? _blocks[b].preds :
+				_blocks[b].succs;
+			var_set s = top;
+			auto join = [&](const var_set& t) {
+				if (meet == UNION)
+					s.unite(t);
+				else
+					s.intersect(t);
+			};
+			for (auto f : from)
+				join(out[f]);
+			if (dir == FORWARD ? b == 0 : _blocks[b].exit)
+				join(boundary);
+			auto t = transfer(b, s);
+			in[b] = std::move(s);
+			if (t != out[b]) {
+				out[b] = std::move(t);
+				changed = true;
+			}
+		}
+	}
+	return in;
+}
+
+} // namespace BASIC
+
+#endif // BASIC_CFG_HPP
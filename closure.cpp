@@ -0,0 +1,495 @@
+#include "machine.hpp"
+
+#include "error.hpp"
+
+// The closure engine of machine: binary code turned into a tree of callables
+// per statement, which read slots and immediates bound into them. They get
+// the machine to run on as an argument, so that the program can be shared.
+// It needs nothing but standard C++.
+
+namespace BASIC {
+
+namespace {
+
+struct add_op {
+	static integer_t apply(integer_t a, integer_t b)
+	{
+		return wrapping_add(a, b);
+	}
+};
+
+struct sub_op {
+	static integer_t apply(integer_t a, integer_t b)
+	{
+		return wrapping_sub(a, b);
+	}
+};
+
+struct mul_op {
+	static integer_t apply(integer_t a, integer_t b)
+	{
+		return wrapping_mul(a, b);
+	}
+};
+
+struct div_op {
+	static integer_t apply(integer_t a, integer_t b)
+	{
+		if (b == 0)
+			throw error::divided_by_zero();
+		return a / b;
+	}
+};
+
+// whether a statement is closed after ins
+bool ends_statement(const instruction& ins)
+{
+	if ((ins.op_lo & 0x0f) == 4)
+		return true;
+	switch (ins.op_lo >> 4) {
+	case instruction::OP_INT:
+	case instruction::OP_HALT:
+	case instruction::OP_PRINT:
+	case instruction::OP_POP:
+	case instruction::OP_JMP:
+	case instruction::OP_JZ:
+	case instruction::OP_JP:
+	case instruction::OP_JNZ:
+	case instruction::OP_JNP:
+		return true;
+	default:
+		return false;
+	}
+}
+
+} // namespace
+
+// Builds the closures of a program. Expressions of stack code are rebuilt as
+// trees on a compile time stack, so that a statement evaluates them by
+// direct calls. Leaves are kept apart from trees, so that an operator over
+// leaves reads them inline instead of calling them.
+struct machine::closure_builder {
+	using expr_fn = std::function<integer_t(machine&)>;
+
+	struct node {
+		enum {
+			IMMEDIATE,
+			VARIABLE,
+			TREE,
+		} kind;
+		integer_t value;
+		expr_fn fn;
+	};
+
+	struct imm_leaf {
+		integer_t n;
+		integer_t operator()(machine&) const
+		{
+			return n;
+		}
+	};
+
+	struct var_leaf {
+		integer_t slot;
+		integer_t operator()(machine& m) const
+		{
+			if (!m.vars.is_defined(slot))
+				throw error::variable_not_defined();
+			return m.vars.value[slot];
+		}
+	};
+
+	const binary_code_t& code;
+	closure_code_t& out;
+	// index of the statement that starts at each instruction, or -1
+	std::vector<std::size_t> stmt_of;
+	std::vector<node> stack;
+	// If building a trace, where it leaves the loop, the statements in the
+	// loop, and the instruction after the current one on the path.
+	std::vector<integer_t>* exits = nullptr;
+	std::size_t trace_len;
+	integer_t path_next;
+
+	closure_builder(const binary_code_t& code, closure_code_t& out):
+		code(code),
+		out(out)
+	{ }
+
+	// Call f with the leaf or the tree of n.
+	template<class F>
+	auto visit(const node& n, F f)
+	{
+		switch (n.kind) {
+		case node::IMMEDIATE:
+			return f(imm_leaf{n.value});
+		case node::VARIABLE:
+			return f(var_leaf{n.value});
+		default:
+			return f(n.fn);
+		}
+	}
+
+	template<class Op>
+	node binary(const node& a, const node& b)
+	{
+		return visit(a, [&](auto x) {
+			return visit(b, [&](auto y) {
+				return node{node::TREE, 0, [x, y](machine& m) {
+					integer_t l = x(m);
+					return Op::apply(l, y(m));
+				}};
+			});
+		});
+	}
+
+	node binary(short_t op, const node& a, const node& b)
+	{
+		switch (op) {
+		case instruction::OP_ADD:
+			return binary<add_op>(a, b);
+		case instruction::OP_SUB:
+			return binary<sub_op>(a, b);
+		case instruction::OP_MUL:
+			return binary<mul_op>(a, b);
+		case instruction::OP_DIV:
+			return binary<div_op>(a, b);
+		default:
+			assert(0);
+			return node();
+		}
+	}
+
+	// source operand i of an instruction in three-address form
+	static node source(const instruction& ins, int i)
+	{
+		if (operand_mode(ins, i) == 1)
+			return {node::IMMEDIATE, ins.operand[i], nullptr};
+		return {node::VARIABLE, ins.operand[i], nullptr};
+	}
+
+	node pop()
+	{
+		auto n = std::move(stack.back());
+		stack.pop_back();
+		return n;
+	}
+
+	std::size_t target(const instruction& ins)
+	{
+		auto s = stmt_of[ins.operand[0]];
+		assert(s != static_cast<std::size_t>(-1));
+		return s;
+	}
+
+	// Statements where the jump at pc goes if taken and if not. In a
+	// trace, the way taken when it was recorded stays in the loop, and the
+	// other one leaves it.
+	void targets(const instruction& ins, integer_t pc, std::size_t& taken,
+			std::size_t& not_taken)
+	{
+		std::size_t next = out.code.size() + 1;
+		taken = not_taken = next;
+		if (!exits) {
+			taken = target(ins);
+		} else if (ins.operand[0] == pc + 1) {
+			return;
+		} else if (ins.operand[0] == path_next) {
+			exits->push_back(pc + 1);
+			not_taken = trace_len + exits->size();
+		} else {
+			exits->push_back(ins.operand[0]);
+			taken = trace_len + exits->size();
+		}
+	}
+
+	void emit(closure_t stmt)
+	{
+		out.code.push_back(std::move(stmt));
+	}
+
+	void set(integer_t slot, const node& n)
+	{
+		std::size_t next = out.code.size() + 1;
+		visit(n, [&](auto x) {
+			emit([slot, x, next](machine& m) {
+				m.vars.set(slot, x(m));
+				return next;
+			});
+		});
+	}
+
+	// n, which is stored in slot when evaluated
+	node store(integer_t slot, const node& n)
+	{
+		return visit(n, [&](auto x) {
+			return node{node::TREE, 0, [slot, x](machine& m) {
+				integer_t v = x(m);
+				m.vars.set(slot, v);
+				return v;
+			}};
+		});
+	}
+
+	void print(const node& n)
+	{
+		std::size_t next = out.code.size() + 1;
+		visit(n, [&](auto x) {
+			emit([x, next](machine& m) {
+				m.print_number(x(m));
+				return next;
+			});
+		});
+	}
+
+	static node input()
+	{
+		return {node::TREE, 0, [](machine& m) {
+			return m.input_number();
+		}};
+	}
+
+	// Go to taken if the difference of a and b is zero (JZ) or positive
+	// (JP), or if a is, for b absent. JNZ and JNP go when those do not.
+	void branch(short_t op, const node& a, const node* b,
+			std::size_t taken, std::size_t not_taken)
+	{
+		if (op == instruction::OP_JNZ || op == instruction::OP_JNP) {
+			std::swap(taken, not_taken);
+			op = op == instruction::OP_JNZ ? instruction::OP_JZ :
+				instruction::OP_JP;
+		}
+		bool jz = op == instruction::OP_JZ;
+		visit(b ? *b : node{node::IMMEDIATE, 0, nullptr}, [&](auto y) {
+			visit(a, [&](auto x) {
+				emit([x, y, jz, taken, not_taken](machine& m) {
+					integer_t l = x(m);
+					integer_t n = wrapping_sub(l, y(m));
+					return (jz ? n == 0 : n > 0) ?
+						taken : not_taken;
+				});
+			});
+		});
+	}
+
+	// Evaluate the rest of the stack, then trap.
+	void trap(std::vector<node> vals)
+	{
+		std::vector<expr_fn> fns;
+		for (auto& n : vals)
+			visit(n, [&](auto x) {
+				fns.push_back(x);
+			});
+		emit([fns](machine& m) -> std::size_t {
+			for (auto& f : fns)
+				f(m);
+			throw error::line_number_error();
+		});
+	}
+
+	void build();
+	void build_trace(const std::vector<integer_t>& path);
+	void build_stack(const instruction& ins, integer_t pc);
+	void build_register(const instruction& ins, integer_t pc);
+};
+
+void machine::closure_builder::build()
+{
+	// Statements are closed by the instructions in ends_statement(), so
+	// where they start is known before building them. Jumps land on line
+	// starts, where the stack is empty.
+	stmt_of.assign(code.size() + 1, -1);
+	std::size_t n = 0;
+	std::size_t depth = 0;
+	for (std::size_t i = 0; i < code.size(); ++i) {
+		if (depth == 0) {
+			stmt_of[i] = n;
+			if (out.start.size() == n)
+				out.start.push_back(i);
+		}
+		depth += stack_effect(code[i]);
+		if ((code[i].op_lo >> 4) == instruction::OP_INT)
+			depth = 0;
+		n += ends_statement(code[i]);
+	}
+	stmt_of[code.size()] = n;
+	if (out.start.size() == n)
+		out.start.push_back(code.size());
+
+	for (std::size_t i = 0; i < code.size(); ++i) {
+		if ((code[i].op_lo & 0x0f) == 4)
+			build_register(code[i], i);
+		else
+			build_stack(code[i], i);
+	}
+	// the end, where the program stops
+	integer_t end = code.size();
+	emit([end](machine& m) {
+		m.reg.PC = end;
+		return CLOSURE_HALT;
+	});
+	assert(out.code.size() == n + 1);
+}
+
+// The path starts at a loop head, and ends with the jump back to it. JMPs
+// on it are dropped, and other jumps become guards.
+void machine::closure_builder::build_trace(const std::vector<integer_t>& path)
+{
+	trace_len = 0;
+	for (auto pc : path)
+		trace_len += ends_statement(code[pc]) &&
+			(code[pc].op_lo >> 4) != instruction::OP_JMP;
+	for (std::size_t i = 0; i < path.size(); ++i) {
+		auto& ins = code[path[i]];
+		path_next = path[(i + 1) % path.size()];
+		if ((ins.op_lo & 0x0f) == 4)
+			build_register(ins, path[i]);
+		else
+			build_stack(ins, path[i]);
+	}
+	assert(stack.empty() && out.code.size() == trace_len);
+}
+
+void machine::closure_builder::build_stack(const instruction& ins, integer_t pc)
+{
+	auto op = ins.op_lo >> 4;
+	switch (op) {
+	case instruction::OP_NOP:
+		break;
+	case instruction::OP_INT: {
+		assert(ins.operand[0] == 0xff);
+		// it may replace a JZ or JP, whose condition is still computed
+		std::vector<node> vals;
+		vals.swap(stack);
+		trap(std::move(vals));
+		break; }
+	case instruction::OP_HALT:
+		emit([pc](machine& m) {
+			m.reg.PC = pc + 1;
+			return CLOSURE_HALT;
+		});
+		break;
+	case instruction::OP_PRINT:
+		print(pop());
+		assert(stack.empty());
+		break;
+	case instruction::OP_INPUT:
+		stack.push_back(input());
+		break;
+	case instruction::OP_PUSH:
+		if ((ins.op_lo & 0x0f) == 1)
+			stack.push_back({node::IMMEDIATE, ins.operand[0], nullptr});
+		else
+			stack.push_back({node::VARIABLE, ins.operand[0], nullptr});
+		break;
+	case instruction::OP_POP:
+		set(ins.operand[0], pop());
+		assert(stack.empty());
+		break;
+	case instruction::OP_STORE:
+		// It may be inside an expression, whose operands below are
+		// read later, so it is a tree too.
+		stack.push_back(store(ins.operand[0], pop()));
+		break;
+	case instruction::OP_ADD:
+	case instruction::OP_SUB:
+	case instruction::OP_MUL:
+	case instruction::OP_DIV: {
+		auto b = pop();
+		auto a = pop();
+		stack.push_back(binary(op, a, b));
+		break; }
+	case instruction::OP_JMP: {
+		if (exits)
+			break;
+		auto t = target(ins);
+		emit([t](machine&) {
+			return t;
+		});
+		break; }
+	case instruction::OP_JZ:
+	case instruction::OP_JP:
+	case instruction::OP_JNZ:
+	case instruction::OP_JNP: {
+		std::size_t taken, not_taken;
+		targets(ins, pc, taken, not_taken);
+		branch(op, pop(), nullptr, taken, not_taken);
+		assert(stack.empty());
+		break; }
+	default:
+		assert(0);
+	}
+}
+
+void machine::closure_builder::build_register(const instruction& ins,
+		integer_t pc)
+{
+	auto op = ins.op_lo >> 4;
+	switch (op) {
+	case instruction::OP_INT: {
+		assert(ins.operand[0] == 0xff);
+		std::vector<node> vals;
+		for (int i = 1; i <= 2; ++i)
+			if (operand_mode(ins, i) == 2)
+				vals.push_back(source(ins, i));
+		trap(std::move(vals));
+		break; }
+	case instruction::OP_PRINT:
+		print(source(ins, 0));
+		break;
+	case instruction::OP_INPUT:
+		set(ins.operand[0], input());
+		break;
+	case instruction::OP_MOV:
+		set(ins.operand[0], source(ins, 1));
+		break;
+	case instruction::OP_ADD:
+	case instruction::OP_SUB:
+	case instruction::OP_MUL:
+	case instruction::OP_DIV:
+		set(ins.operand[0],
+			binary(op, source(ins, 1), source(ins, 2)));
+		break;
+	case instruction::OP_JZ:
+	case instruction::OP_JP:
+	case instruction::OP_JNZ:
+	case instruction::OP_JNP: {
+		std::size_t taken, not_taken;
+		targets(ins, pc, taken, not_taken);
+		auto b = source(ins, 2);
+		branch(op, source(ins, 1), &b, taken, not_taken);
+		break; }
+	default:
+		assert(0);
+	}
+}
+
+void machine::prepare_closure(program& prog)
+{
+	closure_builder(prog.code, prog.closure).build();
+}
+
+void machine::build_superblock(const binary_code_t& code,
+	const std::vector<integer_t>& path, superblock_t& sb)
+{
+	closure_builder b(code, sb.code);
+	b.exits = &sb.exits;
+	b.build_trace(path);
+}
+
+void machine::run_closure(const program& prog)
+{
+	auto& code = prog.closure.code;
+	auto& start = prog.closure.start;
+	// the statement at reg.PC, which is 0, an INPUT or after a HALT
+	std::size_t pc = std::upper_bound(start.begin(), start.end(), reg.PC) -
+		start.begin() - 1;
+	try {
+		for (; pc != CLOSURE_HALT; pc = code[pc](*this))
+			;
+	} catch (input_wanted&) {
+		reg.PC = start[pc];
+		throw;
+	}
+}
+
+} // namespace BASIC
@@ -1,16 +1,30 @@
 #ifndef BASIC_COMMON_HPP
 #define BASIC_COMMON_HPP
 
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <cassert>
 #include <cctype>
+#include <chrono>
+#include <condition_variable>
 #include <cstdint>
 #include <cstring>
+#include <deque>
 #include <experimental/optional>
+#include <fstream>
+#include <functional>
+#include <iomanip>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <set>
 #include <stack>
 #include <sstream>
 #include <string>
+#include <thread>
+#include <tuple>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
@@ -21,6 +35,22 @@
 #define BASIC_ENABLE_EXTENSIONS
 #endif
 
+// Labels as values are a GNU extension. Without them, the direct-threaded
+// engine is not built and the switch engine is used instead.
+#if defined(__GNUC__) && !defined(BASIC_NO_COMPUTED_GOTO)
+#define BASIC_HAVE_COMPUTED_GOTO
+#endif
+
+// The JIT emits x86-64 code for the System V ABI, into memory from mmap.
+#if defined(__x86_64__) && defined(__unix__) && !defined(BASIC_NO_JIT)
+#define BASIC_HAVE_JIT
+#endif
+
+// Hardware performance counters come from perf_event_open(2).
+#if defined(__linux__) && !defined(BASIC_NO_PERF)
+#define BASIC_HAVE_PERF
+#endif
+
 namespace BASIC {
 
 // std::optional
@@ -47,6 +77,29 @@ using integer_t = std::int64_t;
 constexpr integer_t BASIC_INTEGER_MAX = INT64_MAX;
 using short_t = std::int32_t;
 
+// a - b with two's complement wraparound, which is what SUB computes before
+// JZ or JP tests the result. Fused comparisons must not use a < b instead.
+inline integer_t wrapping_sub(integer_t a, integer_t b)
+{
+	return static_cast<integer_t>(static_cast<std::uint64_t>(a) -
+		static_cast<std::uint64_t>(b));
+}
+
+// The same for a + b and a * b. Every engine computes ADD, SUB and MUL with
+// these, and constants are folded with them at link time, so that both
+// wrap around alike.
+inline integer_t wrapping_add(integer_t a, integer_t b)
+{
+	return static_cast<integer_t>(static_cast<std::uint64_t>(a) +
+		static_cast<std::uint64_t>(b));
+}
+
+inline integer_t wrapping_mul(integer_t a, integer_t b)
+{
+	return static_cast<integer_t>(static_cast<std::uint64_t>(a) *
+		static_cast<std::uint64_t>(b));
+}
+
 using basic_code_t = std::map<std::size_t, std::string>;
 
 } // namespace BASIC
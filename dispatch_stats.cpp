@@ -0,0 +1,119 @@
+#include "machine.hpp"
+
+// Counts of what step() dispatches on, built with -DBASIC_DISPATCH_STATS
+// only. Each (opcode, mode) is its op_lo, so pairs fit a square table.
+// The counts go as CSV to the file in $BASIC_DISPATCH_CSV, or to stderr,
+// whenever a program halts.
+
+#ifdef BASIC_DISPATCH_STATS
+
+namespace BASIC {
+
+namespace {
+
+constexpr std::size_t NKINDS = INSTRUCTION_NOPS << 4;
+
+const char* mode_name(short_t mode)
+{
+	switch (mode) {
+	case 0:
+		return "stack";
+	case 1:
+		return "imm";
+	case 2:
+		return "slot";
+	case 4:
+		return "3addr";
+	case 8:
+		return "line";
+	default:
+		return "?";
+	}
+}
+
+// op,mode of op_lo
+void print_kind(std::ostream& os, std::size_t kind)
+{
+	os << asm_lang[kind >> 4] << ',' << mode_name(kind & 0x0f);
+}
+
+} // namespace
+
+struct machine::dispatch_stats {
+	std::vector<std::uint64_t> ops = std::vector<std::uint64_t>(NKINDS);
+	// by op_lo of the first, then of the second
+	std::vector<std::uint64_t> pairs =
+		std::vector<std::uint64_t>(NKINDS * NKINDS);
+	// conditional jumps by op_lo
+	std::vector<std::uint64_t> taken = std::vector<std::uint64_t>(NKINDS);
+	std::vector<std::uint64_t> not_taken =
+		std::vector<std::uint64_t>(NKINDS);
+	// op_lo of the instruction before, or NKINDS at the start of a run
+	std::size_t last = NKINDS;
+};
+
+void machine::count_dispatch(const instruction& ins)
+{
+	if (!_dispatch)
+		_dispatch.reset(new dispatch_stats);
+	auto& d = *_dispatch;
+	std::size_t kind = ins.op_lo;
+	++d.ops[kind];
+	if (d.last != NKINDS)
+		++d.pairs[d.last * NKINDS + kind];
+	d.last = kind;
+}
+
+void machine::count_branch(const instruction& ins, bool taken)
+{
+	auto& d = *_dispatch;
+	++(taken ? d.taken : d.not_taken)[ins.op_lo];
+}
+
+void machine::dump_dispatch()
+{
+	if (!_dispatch)
+		return;
+	auto& d = *_dispatch;
+	std::ofstream file;
+	if (auto path = std::getenv("BASIC_DISPATCH_CSV"))
+		file.open(path);
+	std::ostream& os = file.is_open() ? file : std::cerr;
+	os << "kind,op,mode,next_op,next_mode,count\n";
+	for (std::size_t i = 0; i < NKINDS; ++i) {
+		if (!d.ops[i])
+			continue;
+		os << "op,";
+		print_kind(os, i);
+		os << ",,," << d.ops[i] << '\n';
+	}
+	for (std::size_t i = 0; i < NKINDS * NKINDS; ++i) {
+		if (!d.pairs[i])
+			continue;
+		os << "pair,";
+		print_kind(os, i / NKINDS);
+		os << ',';
+		print_kind(os, i % NKINDS);
+		os << ',' << d.pairs[i] << '\n';
+	}
+	for (std::size_t i = 0; i < NKINDS; ++i) {
+		if (!d.taken[i] && !d.not_taken[i])
+			continue;
+		os << "taken,";
+		print_kind(os, i);
+		os << ",,," << d.taken[i] << '\n';
+		os << "not_taken,";
+		print_kind(os, i);
+		os << ",,," << d.not_taken[i] << '\n';
+	}
+	os << std::flush;
+}
+
+void machine::reset_dispatch()
+{
+	_dispatch.reset();
+}
+
+} // namespace BASIC
+
+#endif // BASIC_DISPATCH_STATS
@@ -50,6 +50,24 @@ struct line_number_error : public basic_error {
 	{ }
 };
 
+struct file_error : public basic_error {
+	file_error():
+		basic_error{"FILE ERROR"}
+	{ }
+};
+
+struct state_mismatch : public basic_error {
+	state_mismatch():
+		basic_error{"STATE MISMATCH"}
+	{ }
+};
+
+struct cannot_continue : public basic_error {
+	cannot_continue():
+		basic_error{"CAN'T CONTINUE"}
+	{ }
+};
+
 struct syntax_error : public basic_error {
 	syntax_error():
 		basic_error{"SYNTAX ERROR"}
@@ -10,6 +10,9 @@ struct expr_token {
 		IMMEDIATE = 0,
 		VARIABLE,
 		OPERATOR,
+		// Only made by the optimizer: store the value on top in the
+		// variable named str, and keep it there.
+		SAVE,
 		// These are for shunting-yard algo.
 		LBRACE = 256,
 		RBRACE = 257,
@@ -22,6 +22,12 @@ struct instruction {
 		OP_JMP,
 		OP_JZ,
 		OP_JP,
+		OP_MOV,
+		// POP to a slot, then PUSH it again
+		OP_STORE,
+		// JZ and JP, jumping when they would not
+		OP_JNZ,
+		OP_JNP,
 	};
 	union {
 		struct {
@@ -29,9 +35,18 @@ struct instruction {
 			//  0 - pure stack operation
 			//  1 - immediate
 			//  2 - variable slot
+			//  4 - three-address form, see op_hi
 			//  8 - operand is a line number
 			short_t op_lo;
-			// op_hi is unused.
+			// op_hi is only used in three-address form. Its n-th
+			// 4 bits is the mode (1, 2 or 8) of operand[n], or 0 if
+			// operand[n] is unused. Stack is not touched.
+			//  ADD/SUB/MUL/DIV $dst, src1, src2
+			//  MOV $dst, src
+			//  PRINT src
+			//  INPUT $dst
+			//  JZ/JP/JNZ/JNP #lineno, src1, src2 - test src1 - src2
+			//  INT %0xff, src1, src2 - fetch sources, then trap
 			short_t op_hi;
 		};
 		integer_t op;
@@ -44,6 +59,37 @@ struct instruction {
 
 using binary_code_t = std::vector<instruction>;
 
+// Mode of operand[i] of an instruction in three-address form.
+inline short_t operand_mode(const instruction& ins, int i)
+{
+	return (ins.op_hi >> (4 * i)) & 0x0f;
+}
+
+// Net change of the operand stack depth after executing ins.
+inline int stack_effect(const instruction& ins)
+{
+	if ((ins.op_lo & 0x0f) == 4)
+		return 0;
+	switch (ins.op_lo >> 4) {
+	case instruction::OP_INPUT:
+	case instruction::OP_PUSH:
+		return 1;
+	case instruction::OP_PRINT:
+	case instruction::OP_POP:
+	case instruction::OP_ADD:
+	case instruction::OP_SUB:
+	case instruction::OP_MUL:
+	case instruction::OP_DIV:
+	case instruction::OP_JZ:
+	case instruction::OP_JP:
+	case instruction::OP_JNZ:
+	case instruction::OP_JNP:
+		return -1;
+	default:
+		return 0;
+	}
+}
+
 constexpr std::size_t INSTRUCTION_ASM_MAXLEN = 8;
 const char asm_lang[][INSTRUCTION_ASM_MAXLEN] = {
 	"NOP",
@@ -60,7 +106,12 @@ const char asm_lang[][INSTRUCTION_ASM_MAXLEN] = {
 	"JMP",
 	"JZ",
 	"JP",
+	"MOV",
+	"STORE",
+	"JNZ",
+	"JNP",
 };
+constexpr std::size_t INSTRUCTION_NOPS = sizeof(asm_lang) / sizeof(asm_lang[0]);
 
 } // namespace BASIC
 
@@ -5,39 +5,138 @@
 namespace BASIC {
 
 #ifdef BASIC_ENABLE_EXTENSIONS
-static void print_program(std::ostream& os, binary_code_t& prog)
+static void print_operand(std::ostream& os, short_t mode, integer_t operand)
+{
+	switch (mode) {
+	case 1: // IMMEDIATE
+		os << "%";
+		break;
+	case 2: // VARIABLE
+		os << "$";
+		break;
+	case 8: // LINENO
+		os << "#";
+		break;
+	default:
+		assert(0);
+	}
+	os << operand;
+}
+
+static void print_program(std::ostream& os, const binary_code_t& prog)
 {
 	std::size_t l = 0;
 	for (auto& ins : prog) {
 		os << l++ << '\t';
 		os << asm_lang[ins.op_lo >> 4];
 		auto type = ins.op_lo & 0x0f;
-		if (type != 0) {
-			os << '\t';
-			switch (type) {
-			case 1: // IMMEDIATE
-				os << "%";
-				break;
-			case 2: // VARIABLE
-				os << "$";
-				break;
-			case 8: // LINENO
-				os << "#";
-				break;
-			default:
-				assert(0);
+		if (type == 4) {
+			// three-address form
+			for (int i = 0; i < instruction::NOPERANDS; ++i) {
+				auto mode = operand_mode(ins, i);
+				if (mode == 0)
+					break;
+				os << (i == 0 ? "\t" : ", ");
+				print_operand(os, mode, ins.operand[i]);
 			}
-			os << ins.operand[0];
+		} else if (type != 0) {
+			os << '\t';
+			print_operand(os, type, ins.operand[0]);
 		}
 		os << std::endl;
 	}
 }
+// Lines that ran, the most costly first: by time, then by instructions.
+static void print_profile(std::ostream& os,
+	std::vector<machine::line_profile> profile)
+{
+	using std::chrono::duration_cast;
+	using std::chrono::microseconds;
+	using std::setw;
+	std::sort(profile.begin(), profile.end(), [](auto& a, auto& b) {
+		return a.time != b.time ? a.time > b.time : a.steps > b.steps;
+	});
+	std::chrono::steady_clock::duration total{};
+	for (auto& l : profile)
+		total += l.time;
+	os << setw(8) << "LINE" << setw(13) << "COUNT" << setw(15) << "STEPS"
+		<< setw(13) << "TIME(us)" << setw(8) << "TIME%" << '\n';
+	for (auto& l : profile) {
+		if (!l.steps)
+			continue;
+		double share = total.count() ?
+			100.0 * l.time.count() / total.count() : 0;
+		os << setw(8) << l.lineno << setw(13) << l.count
+			<< setw(15) << l.steps << setw(13)
+			<< duration_cast<microseconds>(l.time).count()
+			<< setw(8) << std::fixed << std::setprecision(2)
+			<< share << std::defaultfloat << '\n';
+	}
+	os << std::flush;
+}
+
+static void print_stats(std::ostream& os, const machine::run_stats& stats)
+{
+	auto row = [&os](const char* name) -> std::ostream& {
+		return os << std::left << std::setw(16) << name << std::right;
+	};
+	double secs = std::chrono::duration<double>(stats.time).count();
+	row("TIME") << secs << " S\n";
+	if (stats.steps) {
+		row("STEPS") << *stats.steps << '\n';
+		if (secs > 0)
+			row("STEPS/S") << *stats.steps / secs << '\n';
+	}
+	row("STACK BOUND") << stats.stack_bound << '\n';
+	bool any = false;
+	for (int i = 0; i < perf_counters::NCOUNTERS; ++i) {
+		auto& n = stats.counters[i];
+		if (!n)
+			continue;
+		any = true;
+		row(perf_counters::name(
+			static_cast<perf_counters::counter_type>(i))) << *n << '\n';
+	}
+	auto& cycles = stats.counters[perf_counters::CYCLES];
+	auto& insns = stats.counters[perf_counters::INSTRUCTIONS];
+	if (cycles && insns && *cycles)
+		row("IPC") << static_cast<double>(*insns) / *cycles << '\n';
+	if (insns && stats.steps && *stats.steps)
+		row("INSNS/STEP") << static_cast<double>(*insns) / *stats.steps
+			<< '\n';
+	if (!any)
+		os << "NO HARDWARE COUNTERS\n";
+	os << std::flush;
+}
+
+// A state file starts with the names of the variables, so that the program
+// is linked to the same slots again before the machine state is loaded.
+static void save_names(std::ostream& os, const symbol_table& syms)
+{
+	for (auto& name : syms.names())
+		os << name << ' ';
+	os << '\n';
+}
+
+static symbol_table load_names(std::istream& is)
+{
+	std::string line;
+	if (!std::getline(is, line))
+		throw error::file_error();
+	symbol_table syms;
+	std::istringstream ss(line);
+	std::string name;
+	while (ss >> name)
+		syms.get(name);
+	return syms;
+}
 #endif // BASIC_ENABLE_EXTENSIONS
 
 interactive_console::interactive_console():
-	_ld(_vm),
+	_ld(_syms),
 	_prog_expire(true),
-	_quit(false)
+	_quit(false),
+	_can_continue(false)
 { }
 
 void interactive_console::run()
@@ -69,6 +168,7 @@ void interactive_console::run()
 			comm = _comp.compile(c);
 		} catch (error::empty_command&) {
 			_prog_expire = true;
+			_ld.invalidate(lineno);
 			_code.erase(lineno);
 			_obj.erase(lineno);
 			continue;
@@ -77,6 +177,7 @@ void interactive_console::run()
 			continue;
 		}
 		_prog_expire = true;
+		_ld.invalidate(lineno);
 		_code[lineno] = std::move(c);
 		_obj[lineno] = std::move(comm);
 	}
@@ -94,15 +195,191 @@ void interactive_console::special_command(const std::string& s)
 			if (ss >> ch)
 				throw error::syntax_error();
 			link();
-			print_program(std::cout, _prog);
+			print_program(std::cout, _prog.code);
+		} else if (c == "TARGET") {
+			std::string name;
+			if (!(ss >> name) || (ss >> ch))
+				throw error::syntax_error();
+			if (name == "STACK")
+				_ld.set_target(linker::TARGET_STACK);
+			else if (name == "REGISTER")
+				_ld.set_target(linker::TARGET_REGISTER);
+			else
+				throw error::syntax_error();
+			_prog_expire = true;
+		} else if (c == "OPTIMIZE") {
+			std::string arg;
+			if (!(ss >> arg) || (ss >> ch))
+				throw error::syntax_error();
+			if (arg == "ON")
+				_ld.set_optimize(true);
+			else if (arg == "OFF")
+				_ld.set_optimize(false);
+			else
+				throw error::syntax_error();
+			_prog_expire = true;
+		} else if (c == "TRANSLATE") {
+			std::string file;
+			if ((ss >> file) && (ss >> ch))
+				throw error::syntax_error();
+			translator tr;
+			if (file.empty()) {
+				tr.translate(_obj, std::cout);
+				return;
+			}
+			std::ofstream os(file);
+			tr.translate(_obj, os);
+			if (!os.flush())
+				throw error::file_error();
+		} else if (c == "BATCH") {
+			// one set of inputs per line of the file
+			std::string file;
+			if (!(ss >> file) || (ss >> ch))
+				throw error::syntax_error();
+			std::ifstream is(file);
+			if (!is)
+				throw error::file_error();
+			std::vector<std::vector<integer_t>> inputs;
+			std::string line;
+			while (std::getline(is, line)) {
+				std::istringstream ls(line);
+				inputs.emplace_back();
+				integer_t n;
+				while (ls >> n)
+					inputs.back().push_back(n);
+				if (!ls.eof())
+					throw error::invalid_number();
+			}
+			link();
+			if (!_pool)
+				_pool.reset(new thread_pool);
+			auto results = run_batch(_prog, _vm.engine(), inputs,
+				*_pool);
+			for (std::size_t i = 0; i < results.size(); ++i)
+				std::cout << "# " << i + 1 << '\n' << results[i];
+			std::cout << std::flush;
+		} else if (c == "PROFILE") {
+			// RUN, with a report of the cost of each line after it
+			if (ss >> ch)
+				throw error::syntax_error();
+			link();
+			_can_continue = false;
+			_vm.prepare(_prog);
+			_vm.set_profiling(true);
+			try {
+				_vm.run(_prog);
+				_can_continue = true;
+			} catch (error::basic_error& e) {
+				std::cout << e.what() << std::endl;
+			}
+			_vm.set_profiling(false);
+			print_profile(std::cout, _vm.profile());
+		} else if (c == "STATS") {
+			// STATS ON or OFF to measure every run, or STATS to
+			// print what the last one cost
+			std::string arg;
+			if (!(ss >> arg)) {
+				if (!_vm.stats_enabled())
+					std::cout << "STATS ARE OFF" << std::endl;
+				else
+					print_stats(std::cout, _vm.stats());
+				return;
+			}
+			if (ss >> ch)
+				throw error::syntax_error();
+			if (arg == "ON")
+				_vm.set_stats(true);
+			else if (arg == "OFF")
+				_vm.set_stats(false);
+			else
+				throw error::syntax_error();
+		} else if (c == "CONT") {
+			if (ss >> ch)
+				throw error::syntax_error();
+			if (!_can_continue || _prog_expire)
+				throw error::cannot_continue();
+			_can_continue = false;
+			_vm.prepare(_prog);
+			_vm.resume(_prog);
+			_can_continue = true;
+		} else if (c == "SAVESTATE") {
+			std::string file;
+			if (!(ss >> file) || (ss >> ch))
+				throw error::syntax_error();
+			if (!_can_continue || _prog_expire)
+				throw error::cannot_continue();
+			std::ofstream os(file, std::ios::binary);
+			save_names(os, _syms);
+			_vm.save_state(os, _prog);
+			if (!os.flush())
+				throw error::file_error();
+		} else if (c == "LOADSTATE") {
+			std::string file;
+			if (!(ss >> file) || (ss >> ch))
+				throw error::syntax_error();
+			std::ifstream is(file, std::ios::binary);
+			if (!is)
+				throw error::file_error();
+			auto syms = load_names(is);
+			std::swap(syms, _syms);
+			_prog_expire = true;
+			_ld.invalidate();
+			try {
+				link();
+				_vm.prepare(_prog);
+				_vm.load_state(is, _prog);
+			} catch (error::basic_error&) {
+				std::swap(syms, _syms);
+				_prog_expire = true;
+				_ld.invalidate();
+				throw;
+			}
+			_can_continue = true;
+		} else if (c == "ENGINE") {
+			std::string name;
+			if (!(ss >> name)) {
+				std::cout << machine::engine_name(_vm.engine())
+					<< std::endl;
+				return;
+			}
+			if (ss >> ch)
+				throw error::syntax_error();
+			if (name == "SWITCH") {
+				_vm.set_engine(machine::ENGINE_SWITCH);
+			} else if (name == "THREADED") {
+				if (!_vm.set_engine(machine::ENGINE_THREADED))
+					std::cout << "ENGINE NOT AVAILABLE"
+						<< std::endl;
+			} else if (name == "COMPACT") {
+				if (!_vm.set_engine(machine::ENGINE_COMPACT))
+					std::cout << "ENGINE NOT AVAILABLE"
+						<< std::endl;
+			} else if (name == "CLOSURE") {
+				if (!_vm.set_engine(machine::ENGINE_CLOSURE))
+					std::cout << "ENGINE NOT AVAILABLE"
+						<< std::endl;
+			} else if (name == "TRACE") {
+				if (!_vm.set_engine(machine::ENGINE_TRACE))
+					std::cout << "ENGINE NOT AVAILABLE"
+						<< std::endl;
+			} else if (name == "JIT") {
+				if (!_vm.set_engine(machine::ENGINE_JIT))
+					std::cout << "ENGINE NOT AVAILABLE"
+						<< std::endl;
+			} else {
+				throw error::syntax_error();
+			}
 		} else
 #endif // BASIC_ENABLE_EXTENSIONS
 		if (c == "CLEAR") {
-			_prog.clear();
+			_prog = program();
 			_prog_expire = true;
 			_code.clear();
 			_obj.clear();
 			_vm.clear();
+			_syms.clear();
+			_ld.invalidate();
+			_can_continue = false;
 		} else if (c == "HELP") {
 			std::cout << "Sorry, not implemented." << std::endl;
 		} else if (c == "LIST") {
@@ -119,12 +396,18 @@ void interactive_console::special_command(const std::string& s)
 			if (ss >> ch)
 				throw error::syntax_error();
 			link();
+			_can_continue = false;
+			_vm.prepare(_prog);
 			_vm.run(_prog);
+			_can_continue = true;
 		} else if (c == "INPUT" || c == "PRINT" || c == "LET") {
 			object_code_t obj;
 			obj[0] = _comp.compile(s);
 			auto prog = _ld.link(obj);
-			_vm.run(prog);
+			// it runs on _vm, for its variables, but CONT still goes
+			// on where the program stopped
+			_vm.prepare(prog);
+			_vm.run_aside(prog);
 		} else {
 			throw error::syntax_error();
 		}
@@ -136,8 +419,9 @@ void interactive_console::special_command(const std::string& s)
 void interactive_console::link()
 {
 	if (_prog_expire) {
-		_prog = _ld.link(_obj);
+		_prog = _ld.relink(_obj);
 		_prog_expire = false;
+		_can_continue = false;
 	}
 }
 
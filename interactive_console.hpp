@@ -3,9 +3,11 @@
 
 #include "common.hpp"
 
+#include "batch.hpp"
 #include "compiler.hpp"
 #include "interactive_machine.hpp"
 #include "linker.hpp"
+#include "translator.hpp"
 
 namespace BASIC {
 
@@ -20,10 +22,17 @@ private:
 	object_code_t _obj;
 	compiler _comp;
 	interactive_machine _vm;
+	symbol_table _syms;
 	linker _ld;
-	binary_code_t _prog;
+	program _prog;
 	bool _prog_expire; // program expires if any line is changed
 	bool _quit;
+	// whether _vm stopped at an END of _prog, where CONT goes on
+	bool _can_continue;
+#ifdef BASIC_ENABLE_EXTENSIONS
+	// for BATCH, started on its first use
+	std::unique_ptr<thread_pool> _pool;
+#endif
 
 	void link();
 	void run_program(const binary_code_t& prog);
@@ -0,0 +1,731 @@
+#include "machine.hpp"
+
+#include "error.hpp"
+
+// The JIT engine of machine: binary code compiled to x86-64 code for the
+// System V ABI, in memory from mmap.
+
+#ifdef BASIC_HAVE_JIT
+
+#include <cstddef>
+#include <exception>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace BASIC {
+
+// What native code needs at run time. Its address is the only argument of
+// the compiled function.
+struct jit_frame {
+	integer_t* value;
+	std::uint8_t* defined;
+	integer_t* stack;
+	machine* mach;
+	// the number read by jit_input(), and the index of the INPUT, or of
+	// what follows the HALT
+	integer_t input;
+	integer_t pc;
+	// where to start, or null for the beginning
+	const void* resume;
+	// what a callback threw
+	std::exception_ptr error;
+};
+
+namespace {
+
+// Compiled code returns one of these. The machine turns errors into the
+// exceptions of error.hpp, as native code can not throw them itself.
+enum jit_status {
+	JIT_HALT,
+	JIT_LINE_NUMBER_ERROR,
+	JIT_VARIABLE_NOT_DEFINED,
+	JIT_DIVIDED_BY_ZERO,
+	JIT_EXCEPTION,
+	JIT_NSTATUS,
+};
+
+using jit_entry_t = int (*)(jit_frame*);
+using jit_print_t = bool (*)(jit_frame*, integer_t);
+using jit_input_t = bool (*)(jit_frame*);
+
+enum reg_t {
+	RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+	R8, R9, R10, R11, R12, R13, R14, R15,
+};
+
+// Registers of compiled code:
+//  rbx - values of the variables
+//  r12 - definedness bitmap of the variables
+//  r13 - the operand stack of the machine
+//  r14 - the jit_frame
+//  rax, rcx, rdx - scratch
+// Depth of the operand stack is known at each instruction (see
+// linker::max_stack_depth()), so stack[1] to stack[6] are kept in the
+// registers below and deeper ones in the memory at r13. They are caller
+// saved, but PRINT and INPUT run with at most the operand of PRINT on the
+// stack.
+const reg_t stack_regs[] = {R8, R9, R10, R11, RSI, RDI};
+constexpr std::size_t NSTACK_REGS = sizeof(stack_regs) / sizeof(stack_regs[0]);
+
+enum cond_t {
+	CC_Z = 0x4,
+	CC_NZ = 0x5,
+	CC_LE = 0xe,
+	CC_G = 0xf,
+};
+
+// A register, or the memory at [reg + disp].
+struct rm_t {
+	bool mem;
+	reg_t reg;
+	std::int32_t disp;
+};
+
+rm_t reg(reg_t r)
+{
+	return {false, r, 0};
+}
+
+rm_t mem(reg_t base, integer_t disp)
+{
+	assert(disp == static_cast<std::int32_t>(disp));
+	return {true, base, static_cast<std::int32_t>(disp)};
+}
+
+bool fits_int32(integer_t n)
+{
+	return n == static_cast<std::int32_t>(n);
+}
+
+// the condition on the difference under which a conditional jump goes
+cond_t jump_cond(short_t op)
+{
+	switch (op) {
+	case instruction::OP_JZ:
+		return CC_Z;
+	case instruction::OP_JNZ:
+		return CC_NZ;
+	case instruction::OP_JNP:
+		return CC_LE;
+	default:
+		return CC_G;
+	}
+}
+
+// Just enough of an x86-64 assembler for the instructions below. Labels are
+// indices, bound to an offset in code once, and jumps to them are rel32.
+class assembler {
+public:
+	std::vector<std::uint8_t> code;
+
+	void emit(std::initializer_list<std::uint8_t> bytes)
+	{
+		code.insert(code.end(), bytes);
+	}
+	void emit32(std::int32_t n)
+	{
+		for (int i = 0; i < 4; ++i)
+			code.push_back(static_cast<std::uint32_t>(n) >> (8 * i));
+	}
+	void emit64(integer_t n)
+	{
+		for (int i = 0; i < 8; ++i)
+			code.push_back(static_cast<std::uint64_t>(n) >> (8 * i));
+	}
+	// An opcode with a ModRM byte. r is a register, or the opcode
+	// extension of the /digit forms. wide sets REX.W.
+	void modrm(bool wide, std::initializer_list<std::uint8_t> opcode,
+		int r, const rm_t& rm)
+	{
+		std::uint8_t rex = 0x40 | wide << 3 | (r >> 3 & 1) << 2 |
+			(rm.reg >> 3 & 1);
+		if (rex != 0x40)
+			code.push_back(rex);
+		emit(opcode);
+		if (!rm.mem) {
+			code.push_back(0xc0 | (r & 7) << 3 | (rm.reg & 7));
+			return;
+		}
+		bool short_disp = rm.disp == static_cast<std::int8_t>(rm.disp);
+		code.push_back((short_disp ? 0x40 : 0x80) | (r & 7) << 3 |
+			(rm.reg & 7));
+		// rsp and r12 as base need a SIB byte
+		if ((rm.reg & 7) == RSP)
+			code.push_back(0x24);
+		if (short_disp)
+			code.push_back(rm.disp);
+		else
+			emit32(rm.disp);
+	}
+
+	void push(reg_t r)
+	{
+		if (r >= R8)
+			code.push_back(0x41);
+		code.push_back(0x50 | (r & 7));
+	}
+	void pop(reg_t r)
+	{
+		if (r >= R8)
+			code.push_back(0x41);
+		code.push_back(0x58 | (r & 7));
+	}
+	void mov(const rm_t& dst, const rm_t& src)
+	{
+		if (dst.mem && src.mem) {
+			mov(reg(RAX), src);
+			mov(dst, reg(RAX));
+		} else if (dst.mem) {
+			modrm(true, {0x89}, src.reg, dst);
+		} else if (!src.mem && src.reg == dst.reg) {
+			return;
+		} else {
+			modrm(true, {0x8b}, dst.reg, src);
+		}
+	}
+	void mov(const rm_t& dst, integer_t n)
+	{
+		if (fits_int32(n)) {
+			modrm(true, {0xc7}, 0, dst);
+			emit32(n);
+		} else if (!dst.mem) {
+			code.push_back(0x48 | (dst.reg >> 3 & 1));
+			code.push_back(0xb8 | (dst.reg & 7));
+			emit64(n);
+		} else {
+			mov(reg(RAX), n);
+			mov(dst, reg(RAX));
+		}
+	}
+	// dst = dst op src, for op ADD, SUB or MUL
+	void arith(short_t op, reg_t dst, const rm_t& src)
+	{
+		switch (op) {
+		case instruction::OP_ADD:
+			modrm(true, {0x03}, dst, src);
+			break;
+		case instruction::OP_SUB:
+			modrm(true, {0x2b}, dst, src);
+			break;
+		case instruction::OP_MUL:
+			modrm(true, {0x0f, 0xaf}, dst, src);
+			break;
+		default:
+			assert(0);
+		}
+	}
+	void arith(short_t op, reg_t dst, std::int32_t n)
+	{
+		switch (op) {
+		case instruction::OP_ADD:
+			modrm(true, {0x81}, 0, reg(dst));
+			break;
+		case instruction::OP_SUB:
+			modrm(true, {0x81}, 5, reg(dst));
+			break;
+		case instruction::OP_MUL:
+			modrm(true, {0x69}, dst, reg(dst));
+			break;
+		default:
+			assert(0);
+		}
+		emit32(n);
+	}
+	void test(reg_t r)
+	{
+		modrm(true, {0x85}, r, reg(r));
+	}
+	// rax = rdx:rax / src, after sign-extending rax into rdx
+	void cqo_idiv(reg_t src)
+	{
+		emit({0x48, 0x99});
+		modrm(true, {0xf7}, 7, reg(src));
+	}
+	void test_byte(const rm_t& dst, std::uint8_t n)
+	{
+		modrm(false, {0xf6}, 0, dst);
+		code.push_back(n);
+	}
+	void or_byte(const rm_t& dst, std::uint8_t n)
+	{
+		modrm(false, {0x80}, 1, dst);
+		code.push_back(n);
+	}
+	void call(const void* fn)
+	{
+		mov(reg(RAX), reinterpret_cast<integer_t>(fn));
+		modrm(false, {0xff}, 2, reg(RAX));
+	}
+	void jmp(reg_t r)
+	{
+		modrm(false, {0xff}, 4, reg(r));
+	}
+
+	std::size_t new_label()
+	{
+		labels.push_back(-1);
+		return labels.size() - 1;
+	}
+	void bind(std::size_t label)
+	{
+		labels[label] = code.size();
+	}
+	void jmp(std::size_t label)
+	{
+		code.push_back(0xe9);
+		fixup(label);
+	}
+	void jcc(cond_t cc, std::size_t label)
+	{
+		emit({0x0f, static_cast<std::uint8_t>(0x80 | cc)});
+		fixup(label);
+	}
+	std::size_t offset(std::size_t label) const
+	{
+		return labels[label];
+	}
+	// Resolve jumps to labels. Call it once all of them are bound.
+	void link()
+	{
+		for (auto& f : fixups) {
+			assert(labels[f.label] >= 0);
+			std::int32_t rel = labels[f.label] -
+				static_cast<std::ptrdiff_t>(f.at + 4);
+			for (int i = 0; i < 4; ++i)
+				code[f.at + i] =
+					static_cast<std::uint32_t>(rel) >> (8 * i);
+		}
+	}
+
+private:
+	std::vector<std::ptrdiff_t> labels;
+	struct fixup_t {
+		std::size_t at;
+		std::size_t label;
+	};
+	std::vector<fixup_t> fixups;
+
+	void fixup(std::size_t label)
+	{
+		fixups.push_back({code.size(), label});
+		emit32(0);
+	}
+};
+
+class jit_compiler {
+public:
+	jit_compiler(const binary_code_t& code, jit_print_t print,
+			jit_input_t input):
+		code(code),
+		print(print),
+		input(input)
+	{ }
+	std::vector<std::uint8_t> compile();
+	// offsets where a machine may resume: the INPUTs, where it waits for
+	// input, and after the HALTs
+	std::unordered_map<integer_t, std::size_t> entries;
+
+private:
+	const binary_code_t& code;
+	jit_print_t print;
+	jit_input_t input;
+	assembler a;
+	// label of each instruction, and of the end
+	std::vector<std::size_t> lines;
+	std::size_t exits[JIT_NSTATUS];
+	// Variables known to be defined at the current instruction. They never
+	// become undefined while running, so this holds until a jump lands.
+	std::unordered_set<integer_t> known;
+
+	static rm_t var(integer_t slot)
+	{
+		return mem(RBX, slot * 8);
+	}
+	static rm_t stack(std::size_t depth)
+	{
+		assert(depth > 0);
+		if (depth <= NSTACK_REGS)
+			return reg(stack_regs[depth - 1]);
+		return mem(R13, depth * 8);
+	}
+
+	void check(integer_t slot);
+	void define(integer_t slot);
+	void load(reg_t r, const instruction& ins, int i);
+	void apply(short_t op, reg_t r, const instruction& ins, int i);
+	void store(integer_t slot, reg_t r);
+	void call(const void* fn, std::size_t error);
+	void prologue();
+	void epilogue();
+	void compile_stack(const instruction& ins, std::size_t& depth);
+	void compile_register(const instruction& ins);
+};
+
+std::vector<std::uint8_t> jit_compiler::compile()
+{
+	for (std::size_t i = 0; i <= code.size(); ++i)
+		lines.push_back(a.new_label());
+	for (auto& e : exits)
+		e = a.new_label();
+	std::vector<bool> landing(code.size() + 1);
+	for (std::size_t i = 0; i < code.size(); ++i) {
+		auto& ins = code[i];
+		if ((ins.op_lo & 0x0f) == 8 || ((ins.op_lo & 0x0f) == 4 &&
+				operand_mode(ins, 0) == 8))
+			landing[ins.operand[0]] = true;
+		if ((ins.op_lo >> 4) == instruction::OP_INPUT)
+			landing[i] = true;
+		else if ((ins.op_lo >> 4) == instruction::OP_HALT)
+			landing[i + 1] = true;
+	}
+
+	prologue();
+	std::size_t depth = 0;
+	for (std::size_t i = 0; i < code.size(); ++i) {
+		a.bind(lines[i]);
+		if (landing[i])
+			known.clear();
+		auto& ins = code[i];
+		if ((ins.op_lo >> 4) == instruction::OP_INPUT) {
+			entries[i] = lines[i];
+			a.mov(mem(R14, offsetof(jit_frame, pc)), i);
+		} else if ((ins.op_lo >> 4) == instruction::OP_HALT) {
+			entries[i + 1] = lines[i + 1];
+			a.mov(mem(R14, offsetof(jit_frame, pc)), i + 1);
+		}
+		if ((ins.op_lo & 0x0f) == 4)
+			compile_register(ins);
+		else
+			compile_stack(ins, depth);
+	}
+	// running off the end stops, as HALT does
+	a.bind(lines[code.size()]);
+	a.mov(mem(R14, offsetof(jit_frame, pc)), code.size());
+	entries[code.size()] = lines[code.size()];
+	epilogue();
+	a.link();
+	for (auto& e : entries)
+		e.second = a.offset(e.second);
+	return std::move(a.code);
+}
+
+void jit_compiler::prologue()
+{
+	for (auto r : {RBX, RBP, R12, R13, R14, R15})
+		a.push(r);
+	// keep rsp 16-byte aligned at calls
+	a.emit({0x48, 0x83, 0xec, 0x08});
+	a.mov(reg(R14), reg(RDI));
+	a.mov(reg(RBX), mem(R14, offsetof(jit_frame, value)));
+	a.mov(reg(R12), mem(R14, offsetof(jit_frame, defined)));
+	a.mov(reg(R13), mem(R14, offsetof(jit_frame, stack)));
+	std::size_t start = a.new_label();
+	a.mov(reg(RAX), mem(R14, offsetof(jit_frame, resume)));
+	a.test(RAX);
+	a.jcc(CC_Z, start);
+	a.jmp(RAX);
+	a.bind(start);
+}
+
+void jit_compiler::epilogue()
+{
+	std::size_t ret = a.new_label();
+	for (int status = 0; status < JIT_NSTATUS; ++status) {
+		a.bind(exits[status]);
+		// mov eax, status
+		a.code.push_back(0xb8);
+		a.emit32(status);
+		if (status + 1 < JIT_NSTATUS)
+			a.jmp(ret);
+	}
+	a.bind(ret);
+	a.emit({0x48, 0x83, 0xc4, 0x08});
+	for (auto r : {R15, R14, R13, R12, RBP, RBX})
+		a.pop(r);
+	a.code.push_back(0xc3);
+}
+
+void jit_compiler::check(integer_t slot)
+{
+	if (known.count(slot))
+		return;
+	a.test_byte(mem(R12, slot >> 3), 1 << (slot & 7));
+	a.jcc(CC_Z, exits[JIT_VARIABLE_NOT_DEFINED]);
+	known.insert(slot);
+}
+
+void jit_compiler::define(integer_t slot)
+{
+	if (known.count(slot))
+		return;
+	a.or_byte(mem(R12, slot >> 3), 1 << (slot & 7));
+	known.insert(slot);
+}
+
+// r = source operand i of an instruction in three-address form
+void jit_compiler::load(reg_t r, const instruction& ins, int i)
+{
+	if (operand_mode(ins, i) == 1) {
+		a.mov(reg(r), ins.operand[i]);
+	} else {
+		check(ins.operand[i]);
+		a.mov(reg(r), var(ins.operand[i]));
+	}
+}
+
+// r = r op source operand i
+void jit_compiler::apply(short_t op, reg_t r, const instruction& ins, int i)
+{
+	auto n = ins.operand[i];
+	if (operand_mode(ins, i) == 2) {
+		check(n);
+		a.arith(op, r, var(n));
+	} else if (fits_int32(n)) {
+		a.arith(op, r, n);
+	} else {
+		a.mov(reg(RCX), n);
+		a.arith(op, r, reg(RCX));
+	}
+}
+
+void jit_compiler::store(integer_t slot, reg_t r)
+{
+	a.mov(var(slot), reg(r));
+	define(slot);
+}
+
+// Call a callback with the frame as the first argument, which may be
+// followed by rsi. It returns false if it caught an exception.
+void jit_compiler::call(const void* fn, std::size_t error)
+{
+	a.mov(reg(RDI), reg(R14));
+	a.call(fn);
+	// test al, al
+	a.emit({0x84, 0xc0});
+	a.jcc(CC_Z, error);
+}
+
+void jit_compiler::compile_stack(const instruction& ins, std::size_t& depth)
+{
+	auto op = ins.op_lo >> 4;
+	switch (op) {
+	case instruction::OP_NOP:
+		break;
+	case instruction::OP_INT:
+		assert(ins.operand[0] == 0xff);
+		a.jmp(exits[JIT_LINE_NUMBER_ERROR]);
+		// it may replace a JZ or JP, which would pop at the end of
+		// the line
+		depth = 0;
+		break;
+	case instruction::OP_HALT:
+		a.jmp(exits[JIT_HALT]);
+		break;
+	case instruction::OP_PRINT:
+		assert(depth == 1);
+		a.mov(reg(RSI), stack(depth--));
+		call(reinterpret_cast<const void*>(print),
+			exits[JIT_EXCEPTION]);
+		break;
+	case instruction::OP_INPUT:
+		assert(depth == 0);
+		call(reinterpret_cast<const void*>(input),
+			exits[JIT_EXCEPTION]);
+		a.mov(stack(++depth), mem(R14, offsetof(jit_frame, input)));
+		break;
+	case instruction::OP_PUSH:
+		if ((ins.op_lo & 0x0f) == 1) {
+			a.mov(stack(++depth), ins.operand[0]);
+		} else {
+			check(ins.operand[0]);
+			a.mov(stack(++depth), var(ins.operand[0]));
+		}
+		break;
+	case instruction::OP_POP:
+	case instruction::OP_STORE:
+		a.mov(var(ins.operand[0]), stack(depth));
+		define(ins.operand[0]);
+		if (op == instruction::OP_POP)
+			--depth;
+		break;
+	case instruction::OP_ADD:
+	case instruction::OP_SUB:
+	case instruction::OP_MUL: {
+		auto dst = stack(depth - 1);
+		if (dst.mem) {
+			a.mov(reg(RAX), dst);
+			a.arith(op, RAX, stack(depth));
+			a.mov(dst, reg(RAX));
+		} else {
+			a.arith(op, dst.reg, stack(depth));
+		}
+		--depth;
+		break; }
+	case instruction::OP_DIV:
+		a.mov(reg(RCX), stack(depth));
+		a.test(RCX);
+		a.jcc(CC_Z, exits[JIT_DIVIDED_BY_ZERO]);
+		a.mov(reg(RAX), stack(depth - 1));
+		a.cqo_idiv(RCX);
+		a.mov(stack(--depth), reg(RAX));
+		break;
+	case instruction::OP_JMP:
+		a.jmp(lines[ins.operand[0]]);
+		break;
+	case instruction::OP_JZ:
+	case instruction::OP_JP:
+	case instruction::OP_JNZ:
+	case instruction::OP_JNP: {
+		auto src = stack(depth--);
+		if (src.mem) {
+			a.mov(reg(RAX), src);
+			src = reg(RAX);
+		}
+		a.test(src.reg);
+		a.jcc(jump_cond(op), lines[ins.operand[0]]);
+		break; }
+	default:
+		assert(0);
+	}
+}
+
+void jit_compiler::compile_register(const instruction& ins)
+{
+	auto op = ins.op_lo >> 4;
+	switch (op) {
+	case instruction::OP_INT:
+		assert(ins.operand[0] == 0xff);
+		for (int i = 1; i <= 2; ++i)
+			if (operand_mode(ins, i) == 2)
+				check(ins.operand[i]);
+		a.jmp(exits[JIT_LINE_NUMBER_ERROR]);
+		break;
+	case instruction::OP_PRINT:
+		load(RSI, ins, 0);
+		call(reinterpret_cast<const void*>(print),
+			exits[JIT_EXCEPTION]);
+		break;
+	case instruction::OP_INPUT:
+		call(reinterpret_cast<const void*>(input),
+			exits[JIT_EXCEPTION]);
+		a.mov(reg(RAX), mem(R14, offsetof(jit_frame, input)));
+		store(ins.operand[0], RAX);
+		break;
+	case instruction::OP_MOV:
+		load(RAX, ins, 1);
+		store(ins.operand[0], RAX);
+		break;
+	case instruction::OP_ADD:
+	case instruction::OP_SUB:
+	case instruction::OP_MUL:
+		load(RAX, ins, 1);
+		apply(op, RAX, ins, 2);
+		store(ins.operand[0], RAX);
+		break;
+	case instruction::OP_DIV:
+		load(RAX, ins, 1);
+		load(RCX, ins, 2);
+		a.test(RCX);
+		a.jcc(CC_Z, exits[JIT_DIVIDED_BY_ZERO]);
+		a.cqo_idiv(RCX);
+		store(ins.operand[0], RAX);
+		break;
+	case instruction::OP_JZ:
+	case instruction::OP_JP:
+	case instruction::OP_JNZ:
+	case instruction::OP_JNP:
+		// the difference wraps, as in step_register()
+		load(RAX, ins, 1);
+		apply(instruction::OP_SUB, RAX, ins, 2);
+		a.test(RAX);
+		a.jcc(jump_cond(op), lines[ins.operand[0]]);
+		break;
+	default:
+		assert(0);
+	}
+}
+
+} // namespace
+
+native_code_t::~native_code_t()
+{
+	if (_addr)
+		munmap(_addr, _size);
+}
+
+bool machine::jit_print(jit_frame* frame, integer_t n)
+{
+	try {
+		frame->mach->print_number(n);
+	} catch (...) {
+		frame->error = std::current_exception();
+		return false;
+	}
+	return true;
+}
+
+bool machine::jit_input(jit_frame* frame)
+{
+	try {
+		frame->input = frame->mach->input_number();
+	} catch (...) {
+		frame->error = std::current_exception();
+		return false;
+	}
+	return true;
+}
+
+// If memory can not be mapped executable, the program is left unprepared,
+// and run() falls back to the switch engine.
+void machine::prepare_jit(program& prog)
+{
+	jit_compiler jc(prog.code, &jit_print, &jit_input);
+	auto bytes = jc.compile();
+	std::size_t page = sysconf(_SC_PAGESIZE);
+	std::size_t size = (bytes.size() + page - 1) / page * page;
+	void* addr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (addr == MAP_FAILED)
+		return;
+	std::memcpy(addr, bytes.data(), bytes.size());
+	if (mprotect(addr, size, PROT_READ | PROT_EXEC) != 0) {
+		munmap(addr, size);
+		return;
+	}
+	prog.native = native_code_t(addr, size, std::move(jc.entries));
+}
+
+void machine::run_jit(const program& prog)
+{
+	jit_frame frame;
+	frame.value = vars.value.data();
+	frame.defined = reinterpret_cast<std::uint8_t*>(vars.defined.data());
+	frame.stack = stack.data();
+	frame.mach = this;
+	frame.input = 0;
+	frame.pc = 0;
+	frame.resume = reg.PC ? prog.native.entry(reg.PC) : nullptr;
+	auto entry = reinterpret_cast<jit_entry_t>(prog.native.get());
+	switch (entry(&frame)) {
+	case JIT_HALT:
+		reg.PC = frame.pc;
+		break;
+	case JIT_LINE_NUMBER_ERROR:
+		throw error::line_number_error();
+	case JIT_VARIABLE_NOT_DEFINED:
+		throw error::variable_not_defined();
+	case JIT_DIVIDED_BY_ZERO:
+		throw error::divided_by_zero();
+	case JIT_EXCEPTION:
+		// where INPUT stopped, if it threw input_wanted
+		reg.PC = frame.pc;
+		std::rethrow_exception(frame.error);
+	default:
+		assert(0);
+	}
+}
+
+} // namespace BASIC
+
+#endif // BASIC_HAVE_JIT
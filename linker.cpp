@@ -4,47 +4,498 @@
 
 namespace BASIC {
 
-binary_code_t linker::link(const object_code_t& obj)
+static std::atomic<std::uint64_t> last_program_id{0};
+
+program linker::link(const object_code_t& obj)
+{
+	line_notes_t notes;
+	if (!_optimize)
+		return emit(obj, notes, false);
+	auto opt = obj;
+	run_optimizer(opt, notes);
+	return emit(opt, notes, false);
+}
+
+program linker::link(const object_code_t& obj, const line_notes_t& notes)
+{
+	return emit(obj, notes, false);
+}
+
+void linker::run_optimizer(object_code_t& obj, line_notes_t& notes)
+{
+	fold_constants(obj);
+	thread_jumps(obj);
+	drop_unreachable(obj);
+	eliminate_dead_stores(obj);
+	invert_loops(obj, notes);
+	hoist_invariants(obj, notes);
+	close_loops(obj, notes);
+	number_values(obj);
+}
+
+void linker::assign_slots(const object_code_t& obj, const line_notes_t& notes)
+{
+	assign_hot_slots(obj);
+	for (auto& line : obj) {
+		auto& a = line.second;
+		auto n = notes.find(line.first);
+		if (n != notes.end()) {
+			for (auto& h : n->second.hoisted)
+				assign_slots(h);
+			if (auto& count = n->second.count) {
+				get_var_addr(count->count);
+				get_var_addr(count->triangle);
+			}
+		}
+		assign_slots(a);
+		for (auto expr : {&a.expr, &a.expr2})
+			for (auto& token : *expr)
+				if (token.type == expr_token::SAVE)
+					get_var_addr(token.str);
+	}
+}
+
+// The passes of the optimizer look at the whole program, so with them every
+// line is linked again. Lines are also all emitted again if too many of them
+// changed, which is then faster than moving the code around them.
+program linker::relink(const object_code_t& obj)
+{
+	if (_optimize)
+		return link(obj);
+	if (!_relinkable || _changed.size() * 16 > _lines.size())
+		return emit(obj, line_notes_t(), true);
+	relink_changed(obj);
+	return relinked_program();
+}
+
+program linker::emit(const object_code_t& obj, const line_notes_t& notes,
+	bool relinkable)
 {
+	static const line_notes none;
 	bin.clear();
 	l2l.clear();
 	lineno_map.clear();
+	past_hoisted_map.clear();
+	jump_targets.clear();
+	for (auto& line : obj) {
+		auto& a = line.second;
+		if (a.type == command::BASIC_GOTO || a.type == command::BASIC_IF)
+			jump_targets.insert(a.target_lineno);
+	}
+	assign_hot_slots(obj);
 
+	// link() leaves what relink() keeps alone
+	if (relinkable)
+		_lines.clear();
+	landing = false;
 	for (auto& line : obj) {
+		// lines without code, such as REM, share the landing of the next
+		if (lineno_map.empty() || bin.size() != static_cast<std::size_t>(
+				lineno_map.rbegin()->second))
+			landing = false;
+		if (jump_targets.count(line.first))
+			landing = true;
 		lineno_map[line.first] = bin.size();
 		auto& a = line.second;
+		auto n = notes.find(line.first);
+		auto& note = n != notes.end() ? n->second : none;
+		if (!note.hoisted.empty()) {
+			for (auto& h : note.hoisted)
+				emit_command(h);
+			// back edges land here
+			past_hoisted_map[line.first] = bin.size();
+			landing = true;
+		}
+		if (note.count)
+			reg_count(*note.count);
+		jumping_past = note.past_hoisted;
+		if (!relinkable) {
+			emit_command(a, note.negated);
+			continue;
+		}
+		line_code l{line.first, bin.size(), landing, after_pop(), false};
+		emit_command(a);
+		l.fused = l.after_pop != -1 &&
+			bin[l.start - 1].op_lo != ((instruction::OP_POP << 4) | 2);
+		_lines.push_back(l);
+	}
+
+	if (relinkable) {
+		// keep the code as relink_changed() expects it
+		_code = std::move(bin);
+		for (auto& l : _lines)
+			if (l.fused)
+				_code[l.start - 1].op_lo = (instruction::OP_POP << 4) | 2;
+		_jumps = std::move(l2l);
+		_targets.clear();
+		for (auto& line : obj) {
+			auto& a = line.second;
+			if (a.type == command::BASIC_GOTO ||
+					a.type == command::BASIC_IF)
+				++_targets[a.target_lineno];
+		}
+		_changed.clear();
+		_relinkable = true;
+		return relinked_program();
+	}
+
+	program prog;
+	prog.max_stack = max_stack_depth();
+	prog.nvars = _syms.size();
+	prog.id = ++last_program_id;
+
+	// link line numbers
+	auto since = std::chrono::steady_clock::now();
+	linkall_lineno();
+	_lines_time = std::chrono::steady_clock::now() - since;
+
+	prog.lines.resize(bin.size());
+	for (auto it = lineno_map.begin(); it != lineno_map.end(); ++it) {
+		auto next = std::next(it);
+		std::size_t end = next == lineno_map.end() ? bin.size() :
+			next->second;
+		std::fill(prog.lines.begin() + it->second,
+			prog.lines.begin() + end, it->first);
+	}
+	prog.code = std::move(bin);
+	return prog;
+}
+
+// The slot of the POP at the end of bin, which a PUSH of the same slot
+// next may be fused with, or -1.
+integer_t linker::after_pop() const
+{
+	if (_fusion && !landing && !bin.empty() &&
+			bin.back().op_lo == ((instruction::OP_POP << 4) | 2))
+		return bin.back().operand[0];
+	return -1;
+}
+
+// A line is emitted again if it changed, or if it may fuse differently with
+// the POP before it, which emitting the line before it again or a jump that
+// starts or stops landing on it can do. Either way the line after it is
+// looked at next. A line that has no code passes its landing on to the next
+// one, as in emit().
+void linker::relink_changed(const object_code_t& obj)
+{
+	auto index = [this](std::size_t lineno) -> std::size_t {
+		return std::lower_bound(_lines.begin(), _lines.end(), lineno,
+			[](const line_code& l, std::size_t n) {
+				return l.lineno < n;
+			}) - _lines.begin();
+	};
+	auto jumps_at = [this](std::size_t pos) {
+		return std::lower_bound(_jumps.begin(), _jumps.end(), pos,
+			[](const lineno_to_link& j, std::size_t n) {
+				return j.id_bin < n;
+			});
+	};
+
+	relink_hot_slots(obj);
+
+	std::set<std::size_t> work(_changed);
+	auto retarget = [&](std::size_t lineno, bool add) {
+		auto& n = _targets[lineno];
+		if (add ? n++ == 0 : --n == 0)
+			work.insert(lineno);
+		if (!n)
+			_targets.erase(lineno);
+	};
+	for (auto lineno : _changed) {
+		auto i = index(lineno);
+		if (i < _lines.size() && _lines[i].lineno == lineno) {
+			auto last = jumps_at(line_end(i));
+			for (auto j = jumps_at(_lines[i].start); j != last; ++j)
+				retarget(j->lineno, false);
+		}
+		auto it = obj.find(lineno);
+		if (it != obj.end() && (it->second.type == command::BASIC_GOTO ||
+				it->second.type == command::BASIC_IF))
+			retarget(it->second.target_lineno, true);
+	}
+
+	binary_code_t code;
+	while (!work.empty()) {
+		auto lineno = *work.begin();
+		work.erase(work.begin());
+		auto i = index(lineno);
+		bool kept = i < _lines.size() && _lines[i].lineno == lineno;
+		auto it = obj.find(lineno);
+		if (it == obj.end()) {
+			if (!kept)
+				continue;
+			code.clear();
+			l2l.clear();
+			replace_code(i, line_end(i) - _lines[i].start, code, l2l);
+			_lines.erase(_lines.begin() + i);
+			if (i < _lines.size())
+				work.insert(_lines[i].lineno);
+			continue;
+		}
+
+		std::size_t start = i < _lines.size() ? _lines[i].start :
+			_code.size();
+		landing = _targets.count(lineno) || (i > 0 &&
+			_lines[i - 1].start == start && _lines[i - 1].landing);
+		bin.clear();
+		if (start > 0)
+			bin.push_back(_code[start - 1]);
+		auto pop = after_pop();
+		if (kept && !_changed.count(lineno) && pop == _lines[i].after_pop) {
+			if (landing != _lines[i].landing && line_end(i) == start &&
+					i + 1 < _lines.size())
+				work.insert(_lines[i + 1].lineno);
+			_lines[i].landing = landing;
+			continue;
+		}
+
+		l2l.clear();
+		jumping_past = false;
+		emit_command(it->second);
+		std::size_t base = start > 0;
+		code.assign(bin.begin() + base, bin.end());
+		for (auto& j : l2l)
+			j.id_bin += start - base;
+		if (!kept)
+			_lines.insert(_lines.begin() + i, {lineno, start, false, -1,
+				false});
+		replace_code(i, line_end(i) - start, code, l2l);
+		_lines[i].landing = landing;
+		_lines[i].after_pop = pop;
+		_lines[i].fused = pop != -1 &&
+			bin[0].op_lo != ((instruction::OP_POP << 4) | 2);
+		if (i + 1 < _lines.size())
+			work.insert(_lines[i + 1].lineno);
+	}
+	_changed.clear();
+}
+
+// assign_hot_slots() for the lines that changed, the only ones that may
+// name variables without slots. Loops are found from the jumps kept of the
+// other lines, and from those of the changed ones.
+void linker::relink_hot_slots(const object_code_t& obj)
+{
+	std::vector<std::size_t> linenos;
+	std::vector<const command*> comms;
+	for (auto lineno : _changed) {
+		auto it = obj.find(lineno);
+		if (it != obj.end()) {
+			linenos.push_back(lineno);
+			comms.push_back(&it->second);
+		}
+	}
+	std::vector<int> loops(linenos.size() + 1);
+	auto add_loop = [&](std::size_t target, std::size_t source) {
+		if (target > source)
+			return;
+		++loops[std::lower_bound(linenos.begin(), linenos.end(),
+			target) - linenos.begin()];
+		--loops[std::upper_bound(linenos.begin(), linenos.end(),
+			source) - linenos.begin()];
+	};
+	std::size_t i = 0;
+	for (auto& jump : _jumps) {
+		// the line of the jump, the last one that starts at or before it
+		while (i + 1 < _lines.size() && _lines[i + 1].start <= jump.id_bin)
+			++i;
+		if (!_changed.count(_lines[i].lineno))
+			add_loop(jump.lineno, _lines[i].lineno);
+	}
+	for (i = 0; i < comms.size(); ++i)
+		if (comms[i]->type == command::BASIC_GOTO ||
+				comms[i]->type == command::BASIC_IF)
+			add_loop(comms[i]->target_lineno, linenos[i]);
+	int depth = 0;
+	for (i = 0; i < comms.size(); ++i) {
+		depth += loops[i];
+		if (depth)
+			assign_slots(*comms[i]);
+	}
+}
+
+std::size_t linker::line_end(std::size_t i) const
+{
+	return i + 1 < _lines.size() ? _lines[i + 1].start : _code.size();
+}
+
+// Replace the first len instructions at the start of line i, and the jumps
+// among them, and move the code and jumps of the lines after it. The jumps
+// given are by where they will be.
+void linker::replace_code(std::size_t i, std::size_t len,
+	const binary_code_t& code, std::vector<lineno_to_link>& jumps)
+{
+	auto start = _lines[i].start;
+	// may wrap around, as adding it then does
+	std::size_t delta = code.size() - len;
+	auto by_pos = [](const lineno_to_link& j, std::size_t n) {
+		return j.id_bin < n;
+	};
+	auto first = std::lower_bound(_jumps.begin(), _jumps.end(), start,
+		by_pos);
+	auto last = std::lower_bound(first, _jumps.end(), start + len, by_pos);
+	for (auto j = last; j != _jumps.end(); ++j)
+		j->id_bin += delta;
+	_jumps.insert(_jumps.erase(first, last), jumps.begin(), jumps.end());
+
+	if (code.size() > len)
+		_code.insert(_code.begin() + start + len, code.size() - len,
+			instruction());
+	else
+		_code.erase(_code.begin() + start + code.size(),
+			_code.begin() + start + len);
+	std::copy(code.begin(), code.end(), _code.begin() + start);
+	for (auto k = i + 1; k < _lines.size(); ++k)
+		_lines[k].start += delta;
+}
+
+// The program of the code kept, with POPs fused and jumps linked.
+program linker::relinked_program()
+{
+	bin = _code;
+	for (auto& l : _lines)
+		if (l.fused)
+			bin[l.start - 1].op_lo = (instruction::OP_STORE << 4) | 2;
+
+	program prog;
+	prog.max_stack = max_stack_depth();
+	prog.nvars = _syms.size();
+	prog.id = ++last_program_id;
+
+	auto since = std::chrono::steady_clock::now();
+	for (auto& jump : _jumps) {
+		auto it = std::lower_bound(_lines.begin(), _lines.end(),
+			jump.lineno, [](const line_code& l, std::size_t n) {
+				return l.lineno < n;
+			});
+		bool found = it != _lines.end() && it->lineno == jump.lineno;
+		integer_t target = found ? it->start : 0;
+		link_jump(bin[jump.id_bin], jump.id_operand,
+			found ? &target : nullptr);
+	}
+	_lines_time = std::chrono::steady_clock::now() - since;
+
+	prog.lines.resize(bin.size());
+	for (std::size_t i = 0; i < _lines.size(); ++i)
+		std::fill(prog.lines.begin() + _lines[i].start,
+			prog.lines.begin() + line_end(i), _lines[i].lineno);
+	prog.code = std::move(bin);
+	return prog;
+}
+
+void linker::emit_command(const command& a, bool negated)
+{
+	if (_target == TARGET_REGISTER || (_fusion && fusible(a))) {
 		switch (a.type) {
-		case command::BASIC_REM:
-			break;
 		case command::BASIC_LET:
-			expand_expr(a.expr);
-			pop_to_var(a.target_var);
-			break;
+			reg_let(a.expr, a.target_var);
+			return;
 		case command::BASIC_PRINT:
-			expand_expr(a.expr);
-			program_print();
-			break;
+			reg_print(a.expr);
+			return;
 		case command::BASIC_INPUT:
-			input_variable(a.target_var);
-			break;
-		case command::BASIC_GOTO:
-			program_goto(a.target_lineno);
-			break;
+			reg_input(a.target_var);
+			return;
 		case command::BASIC_IF:
-			if_condition(a.expr, a.expr2, a.cmp, a.target_lineno);
-			break;
-		case command::BASIC_END:
-			program_end();
-			break;
+			reg_if(a.expr, a.expr2, a.cmp, negated, a.target_lineno);
+			return;
 		default:
-			assert(0);
+			break;
 		}
 	}
+	switch (a.type) {
+	case command::BASIC_REM:
+		break;
+	case command::BASIC_LET:
+		expand_expr(a.expr);
+		pop_to_var(a.target_var);
+		break;
+	case command::BASIC_PRINT:
+		expand_expr(a.expr);
+		program_print();
+		break;
+	case command::BASIC_INPUT:
+		input_variable(a.target_var);
+		break;
+	case command::BASIC_GOTO:
+		program_goto(a.target_lineno);
+		break;
+	case command::BASIC_IF:
+		if_condition(a.expr, a.expr2, a.cmp, negated, a.target_lineno);
+		break;
+	case command::BASIC_END:
+		program_end();
+		break;
+	default:
+		assert(0);
+	}
+}
 
-	// link line numbers
-	linkall_lineno();
+// Give the variables of loops the first slots, so that they share the first
+// words of the definedness bitmap and the first cache lines of the values.
+// A loop is approximated by the lines between a backward GOTO or IF and its
+// target. Other variables get slots as they are met, and variables known
+// from previous runs keep theirs.
+void linker::assign_hot_slots(const object_code_t& obj)
+{
+	// Each backward jump adds one at the line it lands on and takes it off
+	// after itself; a line is in a loop where the running sum is positive.
+	std::vector<std::size_t> linenos;
+	linenos.reserve(obj.size());
+	for (auto& line : obj)
+		linenos.push_back(line.first);
+	std::vector<int> loops(obj.size() + 1);
+	std::size_t i = 0;
+	for (auto& line : obj) {
+		auto& a = line.second;
+		if ((a.type == command::BASIC_GOTO || a.type == command::BASIC_IF) &&
+				a.target_lineno <= line.first) {
+			auto first = std::lower_bound(linenos.begin(), linenos.end(),
+				a.target_lineno);
+			++loops[first - linenos.begin()];
+			--loops[i + 1];
+		}
+		++i;
+	}
+	i = 0;
+	int depth = 0;
+	for (auto& line : obj) {
+		depth += loops[i++];
+		if (depth)
+			assign_slots(line.second);
+	}
+}
+
+void linker::assign_slots(const command& comm)
+{
+	for (auto expr : {&comm.expr, &comm.expr2})
+		for (auto& token : *expr)
+			if (token.type == expr_token::VARIABLE)
+				get_var_addr(token.str);
+	if (comm.type == command::BASIC_LET || comm.type == command::BASIC_INPUT)
+		get_var_addr(comm.target_var);
+}
 
-	return bin;
+// Superinstructions of the stack target are the three-address forms of
+// statements whose expressions have at most one operator. E.g. LET X = X + 1
+// becomes ADD $X, $X, %1, and IF I < N becomes JP #lineno, $N, $I.
+bool linker::fusible(const command& comm)
+{
+	auto simple = [](const expr_t& expr) {
+		return expr.size() == 1 || (expr.size() == 3 &&
+			expr[2].type == expr_token::OPERATOR);
+	};
+	switch (comm.type) {
+	case command::BASIC_LET:
+		return simple(comm.expr);
+	case command::BASIC_PRINT:
+		return comm.expr.size() == 1;
+	case command::BASIC_INPUT:
+		return true;
+	case command::BASIC_IF:
+		return comm.expr.size() == 1 && comm.expr2.size() == 1;
+	default:
+		return false;
+	}
 }
 
 void linker::expand_expr(const expr_t& expr)
@@ -64,9 +515,21 @@ void linker::expand_expr(const expr_t& expr)
 		case expr_token::OPERATOR:
 			ins.op_lo = (get_operator_op(token.str) << 4) | 0;
 			break;
+		case expr_token::SAVE:
+			ins.op_lo = (instruction::OP_STORE << 4) | 2;
+			ins.operand[0] = get_var_addr(token.str);
+			break;
 		default:
 			assert(0);
 		}
+		// POP $X, PUSH $X is STORE $X, unless a jump lands between
+		if (_fusion && !landing && !bin.empty() &&
+				ins.op_lo == (instruction::OP_PUSH << 4 | 2) &&
+				bin.back().op_lo == (instruction::OP_POP << 4 | 2) &&
+				bin.back().operand[0] == ins.operand[0]) {
+			bin.back().op_lo = (instruction::OP_STORE << 4) | 2;
+			continue;
+		}
 		bin.push_back(std::move(ins));
 	}
 }
@@ -108,7 +571,7 @@ void linker::program_goto(std::size_t lineno)
 }
 
 void linker::if_condition(const expr_t& exprl, const expr_t& exprr,
-		const std::string& cmp, std::size_t lineno)
+		const std::string& cmp, bool negated, std::size_t lineno)
 {
 	auto do_sub = [this]() {
 		instruction ins;
@@ -136,6 +599,8 @@ void linker::if_condition(const expr_t& exprl, const expr_t& exprr,
 	} else {
 		assert(0);
 	}
+	if (negated)
+		ins.op_lo = (negate_jump(ins.op_lo >> 4) << 4) | 8;
 	ask_lineno(lineno);
 	bin.push_back(std::move(ins));
 }
@@ -162,17 +627,203 @@ void linker::push_number(const expr_token& token)
 	bin.push_back(std::move(ins));
 }
 
-integer_t linker::get_var_addr(const std::string& var)
+// Three-address code keeps a compile time stack of operands instead of
+// pushing them. Operators write to a temporary slot per stack position, or to
+// dst directly if it is the last one.
+//
+// Variables are only checked when an instruction reads them, which is later
+// than PUSH would check them. That is fine unless a DIV traps in between, so
+// unchecked variables are fetched into temporaries before such a DIV.
+void linker::reg_expand_expr(const expr_t& expr, reg_stack_t& vals,
+		const reg_operand* dst)
+{
+	for (std::size_t i = 0; i < expr.size(); ++i) {
+		auto& token = expr[i];
+		switch (token.type) {
+		case expr_token::IMMEDIATE:
+			vals.push_back({1, token.num, false});
+			break;
+		case expr_token::VARIABLE:
+			// hidden variables are always defined when read
+			vals.push_back({2, get_var_addr(token.str),
+				token.str[0] != '~'});
+			break;
+		case expr_token::OPERATOR: {
+			auto op = get_operator_op(token.str);
+			auto b = vals.back();
+			vals.pop_back();
+			auto a = vals.back();
+			vals.pop_back();
+			if (op == instruction::OP_DIV &&
+					(b.mode != 1 || b.value == 0))
+				reg_check_operands(vals);
+			auto result = reg_temp(vals.size());
+			if (dst && i + 1 == expr.size())
+				result = *dst;
+			emit_reg(op, {result, a, b});
+			vals.push_back(result);
+			break; }
+		case expr_token::SAVE: {
+			// the operator before writes the variable instead
+			reg_operand var{2, get_var_addr(token.str), false};
+			bin.back().operand[0] = var.value;
+			vals.back() = var;
+			break; }
+		default:
+			assert(0);
+		}
+	}
+}
+
+void linker::reg_check_operands(reg_stack_t& vals)
+{
+	for (std::size_t i = 0; i < vals.size(); ++i) {
+		if (!vals[i].unchecked)
+			continue;
+		auto temp = reg_temp(i);
+		emit_reg(instruction::OP_MOV, {temp, vals[i]});
+		vals[i] = temp;
+	}
+}
+
+void linker::reg_let(const expr_t& expr, const std::string& var)
+{
+	reg_operand dst{2, get_var_addr(var), false};
+	reg_stack_t vals;
+	reg_expand_expr(expr, vals, &dst);
+	if (expr.size() == 1 || expr.back().type == expr_token::SAVE)
+		emit_reg(instruction::OP_MOV, {dst, vals.back()});
+}
+
+void linker::reg_print(const expr_t& expr)
+{
+	reg_stack_t vals;
+	reg_expand_expr(expr, vals, nullptr);
+	emit_reg(instruction::OP_PRINT, {vals.back()});
+}
+
+void linker::reg_input(const std::string& var)
+{
+	emit_reg(instruction::OP_INPUT, {{2, get_var_addr(var), false}});
+}
+
+// The same evaluation order as if_condition(). If the line does not exist,
+// linkall_lineno() keeps the sources so that they are still checked.
+void linker::reg_if(const expr_t& exprl, const expr_t& exprr,
+		const std::string& cmp, bool negated, std::size_t lineno)
+{
+	reg_stack_t vals;
+	short_t op;
+	if (cmp == "=") {
+		reg_expand_expr(exprl, vals, nullptr);
+		reg_expand_expr(exprr, vals, nullptr);
+		op = instruction::OP_JZ;
+	} else if (cmp == ">") {
+		reg_expand_expr(exprl, vals, nullptr);
+		reg_expand_expr(exprr, vals, nullptr);
+		op = instruction::OP_JP;
+	} else if (cmp == "<") {
+		reg_expand_expr(exprr, vals, nullptr);
+		reg_expand_expr(exprl, vals, nullptr);
+		op = instruction::OP_JP;
+	} else {
+		assert(0);
+	}
+	if (negated)
+		op = negate_jump(op);
+	ask_lineno(lineno);
+	emit_reg(op, {{8, 0, false}, vals[0], vals[1]});
+}
+
+// See loop_count. The jumps in here land on instructions of the same line,
+// and are patched as soon as those are emitted.
+void linker::reg_count(const loop_count& lc)
 {
-	auto it = _mach.var_map.find(var);
-	if (it == _mach.var_map.end()) {
-		integer_t result = _mach.vars.size();
-		_mach.var_map.emplace(var, result);
-		_mach.vars.push_back(std_nullopt);
-		return result;
+	reg_operand diff{2, get_var_addr(lc.diff), false};
+	reg_operand count{2, get_var_addr(lc.count), false};
+	reg_operand triangle{2, get_var_addr(lc.triangle), false};
+	auto imm = [](integer_t n) {
+		return reg_operand{1, n, false};
+	};
+	reg_operand nowhere{8, 0, false};
+	bool up = lc.step > 0;
+	if (lc.test == loop_count::ZERO && lc.negated) {
+		// until diff + count * step is 0
+		if (up)
+			emit_reg(instruction::OP_SUB, {count, imm(0), diff});
+		else
+			emit_reg(instruction::OP_MOV, {count, diff});
 	} else {
-		return it->second;
+		emit_reg(instruction::OP_MOV, {count, imm(0)});
+		auto skip = bin.size();
+		if (lc.test == loop_count::ZERO) {
+			// once more if diff is 0
+			emit_reg(instruction::OP_JNZ, {nowhere, diff, imm(0)});
+			emit_reg(instruction::OP_MOV, {count, imm(1)});
+		} else if (!lc.negated) {
+			// while positive: down to 0, or up past the greatest
+			emit_reg(instruction::OP_JNP, {nowhere, diff, imm(0)});
+			if (up)
+				emit_reg(instruction::OP_SUB,
+					{count, imm(INT64_MIN), diff});
+			else
+				emit_reg(instruction::OP_MOV, {count, diff});
+		} else {
+			// while not positive: up to 1, or down past the least
+			emit_reg(instruction::OP_JP, {nowhere, diff, imm(0)});
+			if (up)
+				emit_reg(instruction::OP_SUB, {count, imm(1), diff});
+			else
+				emit_reg(instruction::OP_SUB,
+					{count, diff, imm(BASIC_INTEGER_MAX)});
+		}
+		bin[skip].operand[0] = bin.size();
 	}
+
+	// With b = count % 2 as unsigned, the triangle is
+	// ((count - b) / 2 + b) * (count + 1 - b), where the division is
+	// unsigned too: signed, it is 2^63 less if negative.
+	auto half = reg_temp(0);
+	auto b = reg_temp(1);
+	emit_reg(instruction::OP_DIV, {half, count, imm(2)});
+	emit_reg(instruction::OP_MUL, {half, half, imm(2)});
+	emit_reg(instruction::OP_SUB, {b, count, half});
+	emit_reg(instruction::OP_MUL, {b, b, b});
+	emit_reg(instruction::OP_SUB, {half, count, b});
+	emit_reg(instruction::OP_DIV, {half, half, imm(2)});
+	auto skip = bin.size();
+	emit_reg(instruction::OP_JP, {nowhere, half, imm(-1)});
+	emit_reg(instruction::OP_ADD, {half, half, imm(INT64_MIN)});
+	bin[skip].operand[0] = bin.size();
+	emit_reg(instruction::OP_ADD, {half, half, b});
+	emit_reg(instruction::OP_ADD, {triangle, count, imm(1)});
+	emit_reg(instruction::OP_SUB, {triangle, triangle, b});
+	emit_reg(instruction::OP_MUL, {triangle, half, triangle});
+}
+
+void linker::emit_reg(short_t op, std::initializer_list<reg_operand> operands)
+{
+	instruction ins;
+	std::memset(&ins, 0, sizeof(ins));
+	ins.op_lo = (op << 4) | 4;
+	int i = 0;
+	for (auto& o : operands) {
+		ins.op_hi |= o.mode << (4 * i);
+		ins.operand[i] = o.value;
+		++i;
+	}
+	bin.push_back(std::move(ins));
+}
+
+// Temporaries are slots of names that no BASIC variable can have.
+linker::reg_operand linker::reg_temp(std::size_t i)
+{
+	return {2, get_var_addr("~R" + std::to_string(i)), false};
+}
+
+integer_t linker::get_var_addr(const std::string& var)
+{
+	return _syms.get(var);
 }
 
 short_t linker::get_operator_op(const std::string& oper)
@@ -197,26 +848,67 @@ short_t linker::get_operator_op(const std::string& oper)
 	return result;
 }
 
+short_t linker::negate_jump(short_t op)
+{
+	return op == instruction::OP_JZ ? instruction::OP_JNZ :
+		instruction::OP_JNP;
+}
+
 void linker::ask_lineno(std::size_t lineno)
 {
-	l2l.push_back({bin.size(), 0, lineno});
+	l2l.push_back({bin.size(), 0, lineno, jumping_past});
 }
 
 void linker::linkall_lineno()
 {
 	for (auto& entry : l2l) {
 		auto it = lineno_map.find(entry.lineno);
-		auto& ins = bin[entry.id_bin];
-		if (it == lineno_map.end()) {
-			// if not found, replace the instruction with INT 0xff,
-			// which will cause the VM to throw line_number_error.
-			std::memset(&ins, 0, sizeof(ins));
-			ins.op_lo = (instruction::OP_INT << 4) | 1;
-			ins.operand[0] = 0xff;
-		} else {
-			ins.operand[entry.id_operand] = it->second;
+		if (entry.past_hoisted) {
+			auto past = past_hoisted_map.find(entry.lineno);
+			if (past != past_hoisted_map.end())
+				it = past;
 		}
+		link_jump(bin[entry.id_bin], entry.id_operand,
+			it == lineno_map.end() ? nullptr : &it->second);
 	}
 }
 
+// Make the jump go to target, or to no line if it is null.
+void linker::link_jump(instruction& ins, std::size_t id_operand,
+	const integer_t* target)
+{
+	if (!target && (ins.op_lo & 0x0f) == 4) {
+		// the same, but keep the sources of the jump
+		ins.op_lo = (instruction::OP_INT << 4) | 4;
+		ins.op_hi = (ins.op_hi & ~0x0f) | 1;
+		ins.operand[0] = 0xff;
+	} else if (!target) {
+		// if not found, replace the instruction with INT 0xff,
+		// which will cause the VM to throw line_number_error.
+		std::memset(&ins, 0, sizeof(ins));
+		ins.op_lo = (instruction::OP_INT << 4) | 1;
+		ins.operand[0] = 0xff;
+	} else {
+		ins.operand[id_operand] = *target;
+	}
+}
+
+// Every line starts and ends with an empty stack, and jumps only land on line
+// starts, or between the three-address instructions of a loop count, where
+// it is empty too. So the depth at each instruction does not depend on the
+// path taken and one linear scan is enough. Done before jumps to missing lines become
+// INT, which leaves the stack as it is.
+std::size_t linker::max_stack_depth()
+{
+	std::size_t depth = 0;
+	std::size_t result = 0;
+	for (auto& ins : bin) {
+		depth += stack_effect(ins);
+		if (depth > result)
+			result = depth;
+	}
+	assert(depth == 0);
+	return result;
+}
+
 } // namespace BASIC
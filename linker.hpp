@@ -4,27 +4,155 @@
 #include "common.hpp"
 
 #include "command.hpp"
-#include "machine.hpp"
+#include "optimizer.hpp"
+#include "program.hpp"
+#include "symbol_table.hpp"
 
 namespace BASIC {
 
 class linker {
 public:
-	linker(machine& mach):
-		_mach(mach)
+	enum target_type {
+		// stack code, as in PUSH $A, PUSH %1, ADD, POP $A
+		TARGET_STACK,
+		// three-address code, as in ADD $A, $A, %1
+		TARGET_REGISTER,
+	};
+	linker(symbol_table& syms):
+		_syms(syms),
+		_target(TARGET_STACK),
+		_fusion(true),
+		_optimize(true),
+		_lines_time(),
+		_relinkable(false)
 	{ }
-	binary_code_t link(const object_code_t& obj);
+	void set_target(target_type target)
+	{
+		if (target != _target)
+			invalidate();
+		_target = target;
+	}
+	target_type target() const
+	{
+		return _target;
+	}
+	// Whether the stack target emits superinstructions for frequent shapes
+	// of code. On by default.
+	void set_fusion(bool fusion)
+	{
+		if (fusion != _fusion)
+			invalidate();
+		_fusion = fusion;
+	}
+	// Whether the passes of optimizer.hpp run before code is emitted. On
+	// by default.
+	void set_optimize(bool optimize)
+	{
+		if (optimize != _optimize)
+			invalidate();
+		_optimize = optimize;
+	}
+	bool optimize() const
+	{
+		return _optimize;
+	}
+	program link(const object_code_t& obj);
+	// link() for object code that run_optimizer() left with notes, which
+	// is emitted as it is.
+	program link(const object_code_t& obj, const line_notes_t& notes);
+	// The passes of optimizer.hpp, in the order link() runs them.
+	static void run_optimizer(object_code_t& obj, line_notes_t& notes);
+	// Give every variable of obj a slot, those of loops first, which
+	// link() does as it emits code. Only to measure it alone.
+	void assign_slots(const object_code_t& obj, const line_notes_t& notes);
+	// How long linking the line numbers of jumps took in the last link()
+	// or relink().
+	std::chrono::steady_clock::duration lines_time() const
+	{
+		return _lines_time;
+	}
+	// link(), for object code that changes a few lines at a time, each of
+	// which must be passed to invalidate() before. Without optimization,
+	// the code of every line is kept, and only lines that changed, or that
+	// now follow code they may fuse with differently, are emitted again.
+	// The rest is moved, and jumps are relocated. The program is the same
+	// as link() would make. With optimization on, the default, it is only
+	// link().
+	program relink(const object_code_t& obj);
+	void invalidate(std::size_t lineno)
+	{
+		_changed.insert(lineno);
+	}
+	// Link every line again on the next relink(), e.g. if the symbol
+	// table is not the one they were linked with.
+	void invalidate()
+	{
+		_relinkable = false;
+	}
 
 private:
-	machine& _mach;
+	symbol_table& _syms;
+	target_type _target;
+	bool _fusion;
+	bool _optimize;
+	std::chrono::steady_clock::duration _lines_time;
 	binary_code_t bin;
 	struct lineno_to_link {
 		std::size_t id_bin;
 		std::size_t id_operand;
 		std::size_t lineno;
+		// to land after the hoisted LETs of the line
+		bool past_hoisted;
 	};
 	std::vector<lineno_to_link> l2l;
 	std::map<std::size_t, integer_t> lineno_map;
+	// where code starts after the hoisted LETs of lines that have them
+	std::map<std::size_t, integer_t> past_hoisted_map;
+	// line numbers that GOTO or IF may jump to
+	std::unordered_set<std::size_t> jump_targets;
+	// whether some jump may land at the end of bin
+	bool landing;
+	// whether the jump of the command being emitted lands after the
+	// hoisted LETs of its target
+	bool jumping_past;
+
+	// What relink() keeps of the last program, so that lines can be
+	// emitted again in place: the code of each line, before jumps are
+	// linked and POPs are fused with PUSHes of the next line, and the
+	// jumps in it, by where they are.
+	struct line_code {
+		std::size_t lineno;
+		std::size_t start;
+		// whether a jump may land at its start, as landing
+		bool landing;
+		// the slot of the POP just before it, which a PUSH of that
+		// slot at its start may be fused with, or -1
+		integer_t after_pop;
+		// whether it was, into STORE
+		bool fused;
+	};
+	bool _relinkable;
+	std::vector<line_code> _lines;
+	binary_code_t _code;
+	std::vector<lineno_to_link> _jumps;
+	// how many jumps go to each line number
+	std::unordered_map<std::size_t, std::size_t> _targets;
+	// lines passed to invalidate() since
+	std::set<std::size_t> _changed;
+
+	program emit(const object_code_t& obj, const line_notes_t& notes,
+		bool relinkable);
+	void emit_command(const command& comm, bool negated = false);
+	void assign_hot_slots(const object_code_t& obj);
+	void assign_slots(const command& comm);
+	integer_t after_pop() const;
+	void relink_changed(const object_code_t& obj);
+	void relink_hot_slots(const object_code_t& obj);
+	std::size_t line_end(std::size_t i) const;
+	void replace_code(std::size_t i, std::size_t len,
+		const binary_code_t& code, std::vector<lineno_to_link>& jumps);
+	program relinked_program();
+	bool fusible(const command& comm);
 
 	void expand_expr(const expr_t& expr);
 	void pop_to_var(const std::string& var);
@@ -32,14 +160,39 @@ private:
 	void input_variable(const std::string& var);
 	void program_goto(std::size_t lineno);
 	void if_condition(const expr_t& exprl, const expr_t& exprr,
-		const std::string& cmp, std::size_t lineno);
+		const std::string& cmp, bool negated, std::size_t lineno);
 	void program_end();
 	void push_number(const expr_token& token);
 
+	// Operand of three-address code. mode is 1 (immediate) or 2 (slot).
+	struct reg_operand {
+		short_t mode;
+		integer_t value;
+		// a variable whose definedness is not checked yet
+		bool unchecked;
+	};
+	using reg_stack_t = std::vector<reg_operand>;
+	void reg_expand_expr(const expr_t& expr, reg_stack_t& vals,
+		const reg_operand* dst);
+	void reg_check_operands(reg_stack_t& vals);
+	void reg_let(const expr_t& expr, const std::string& var);
+	void reg_print(const expr_t& expr);
+	void reg_input(const std::string& var);
+	void reg_if(const expr_t& exprl, const expr_t& exprr,
+		const std::string& cmp, bool negated, std::size_t lineno);
+	void reg_count(const loop_count& count);
+	void emit_reg(short_t op, std::initializer_list<reg_operand> operands);
+	reg_operand reg_temp(std::size_t i);
+
 	integer_t get_var_addr(const std::string& var);
 	short_t get_operator_op(const std::string& oper);
+	// JNZ for JZ, JNP for JP
+	short_t negate_jump(short_t op);
 	void ask_lineno(std::size_t lineno);
 	void linkall_lineno();
+	void link_jump(instruction& ins, std::size_t id_operand,
+		const integer_t* target);
+	std::size_t max_stack_depth();
 };
 
 } // namespace BASIC
@@ -4,21 +4,230 @@
 
 namespace BASIC {
 
-void machine::run(const binary_code_t& prog)
+machine::machine():
+#if defined(BASIC_HAVE_COMPUTED_GOTO) && !defined(BASIC_DISPATCH_STATS)
+	_engine(ENGINE_THREADED)
+#else
+	_engine(ENGINE_SWITCH)
+#endif
+{
+	reg.PC = reg.STEP = reg.STOP = reg.SP = 0;
+	_profiling = false;
+}
+
+bool machine::set_engine(engine_type engine)
+{
+#ifdef BASIC_DISPATCH_STATS
+	// only step() counts what it dispatches on
+	if (engine != ENGINE_SWITCH)
+		return false;
+#endif
+#ifndef BASIC_HAVE_COMPUTED_GOTO
+	if (engine == ENGINE_THREADED || engine == ENGINE_COMPACT)
+		return false;
+#endif
+#ifndef BASIC_HAVE_JIT
+	if (engine == ENGINE_JIT)
+		return false;
+#endif
+	_engine = engine;
+	return true;
+}
+
+const char* machine::engine_name(engine_type engine)
+{
+	switch (engine) {
+	case ENGINE_SWITCH:
+		return "SWITCH";
+	case ENGINE_THREADED:
+		return "THREADED";
+	case ENGINE_COMPACT:
+		return "COMPACT";
+	case ENGINE_JIT:
+		return "JIT";
+	case ENGINE_CLOSURE:
+		return "CLOSURE";
+	case ENGINE_TRACE:
+		return "TRACE";
+	default:
+		assert(0);
+	}
+	return "";
+}
+
+void machine::prepare(program& prog)
+{
+	if (_engine == ENGINE_CLOSURE && prog.closure.code.empty())
+		prepare_closure(prog);
+#ifdef BASIC_HAVE_COMPUTED_GOTO
+	if (_engine == ENGINE_THREADED && prog.threaded.empty())
+		prepare_threaded(prog);
+	else if (_engine == ENGINE_COMPACT && prog.compact.code.empty())
+		prepare_compact(prog);
+#endif
+#ifdef BASIC_HAVE_JIT
+	if (_engine == ENGINE_JIT && prog.native.empty())
+		prepare_jit(prog);
+#endif
+	(void)prog;
+}
+
+machine::run_status machine::run(const program& prog)
+{
+	reg.PC = reg.STEP = reg.STOP = reg.SP = 0;
+	if (stack.size() < prog.max_stack + 1)
+		stack.resize(prog.max_stack + 1);
+	if (vars.size() < prog.nvars)
+		vars.resize(prog.nvars);
+	_profile = profile_t();
+#ifdef BASIC_DISPATCH_STATS
+	reset_dispatch();
+#endif
+	return resume(prog);
+}
+
+machine::run_status machine::run_aside(const program& prog)
+{
+	struct restore {
+		machine& m;
+		registers reg;
+		profile_t profile;
+
+		~restore()
+		{
+			m.reg = reg;
+			m._profile = std::move(profile);
+		}
+	} guard{*this, reg, std::move(_profile)};
+	return run(prog);
+}
+
+// Every engine starts at reg.PC, and leaves it at the INPUT that threw
+// input_wanted, or after the HALT. The operand stack is empty there, as
+// both are statements of their own.
+machine::run_status machine::resume(const program& prog)
+{
+	// measures the run however it ends, errors included, if asked to
+	struct measure {
+		machine& m;
+		const program& prog;
+		integer_t steps;
+		std::chrono::steady_clock::time_point since;
+
+		measure(machine& m, const program& prog):
+			m(m),
+			prog(prog)
+		{
+			if (!m._perf)
+				return;
+			steps = m.reg.STEP;
+			since = std::chrono::steady_clock::now();
+			m._perf->start();
+		}
+		~measure()
+		{
+			if (!m._perf)
+				return;
+			auto& s = m._stats;
+			s = run_stats();
+			s.counters = m._perf->stop();
+			s.time = std::chrono::steady_clock::now() - since;
+			if (m.counts_steps())
+				s.steps = m.reg.STEP - steps;
+			s.stack_bound = prog.max_stack;
+		}
+	} guard(*this, prog);
+
+	reg.STOP = 0;
+	try {
+		run_engine(prog);
+	} catch (input_wanted&) {
+		return RUN_WAITING;
+	}
+#ifdef BASIC_DISPATCH_STATS
+	dump_dispatch();
+#endif
+	return RUN_HALTED;
+}
+
+void machine::set_stats(bool stats)
+{
+	if (!stats)
+		_perf.reset();
+	else if (!_perf)
+		_perf.reset(new perf_counters);
+}
+
+// Whether the engine that run_engine() picks counts reg.STEP.
+bool machine::counts_steps() const
+{
+	if (_profiling || _engine == ENGINE_SWITCH)
+		return true;
+#ifdef BASIC_HAVE_COMPUTED_GOTO
+	return _engine == ENGINE_THREADED || _engine == ENGINE_COMPACT;
+#else
+	return false;
+#endif
+}
+
+void machine::run_engine(const program& prog)
+{
+	if (_profiling) {
+		run_profiled(prog);
+		return;
+	}
+	if (_engine == ENGINE_CLOSURE && !prog.closure.code.empty()) {
+		run_closure(prog);
+		return;
+	}
+	if (_engine == ENGINE_TRACE) {
+		run_trace(prog);
+		return;
+	}
+#ifdef BASIC_HAVE_COMPUTED_GOTO
+	if ((_engine == ENGINE_THREADED && !prog.threaded.empty()) ||
+			(_engine == ENGINE_COMPACT && !prog.compact.code.empty())) {
+		run_threaded(prog);
+		return;
+	}
+#endif
+#ifdef BASIC_HAVE_JIT
+	if (_engine == ENGINE_JIT && !prog.native.empty()) {
+		run_jit(prog);
+		return;
+	}
+#endif
+	run_switch(prog.code);
+}
+
+void machine::run_switch(const binary_code_t& prog)
 {
-	reg.PC = reg.STEP = reg.STOP = 0;
 	while (!reg.STOP && static_cast<size_t>(reg.PC) < prog.size()) {
 		step(prog[reg.PC]);
 	}
 }
 
+#ifdef BASIC_DISPATCH_STATS
+#define COUNT_BRANCH(taken) count_branch(ins, taken)
+#else
+#define COUNT_BRANCH(taken) ((void)0)
+#endif
+
 void machine::step(const instruction& ins)
 {
+#ifdef BASIC_DISPATCH_STATS
+	count_dispatch(ins);
+#endif
 	++reg.PC;
 	++reg.STEP;
 	auto op = ins.op_lo >> 4;
 	auto mode = ins.op_lo & 0x0f;
 
+	if (mode == 0x04) {
+		step_register(ins);
+		return;
+	}
+
 	switch (op) {
 	case instruction::OP_NOP:
 		break;
@@ -29,74 +238,181 @@ void machine::step(const instruction& ins)
 		reg.STOP = 1;
 		break;
 	case instruction::OP_PRINT:
-		print_number(stack.top());
-		stack.pop();
-		break;
-	case instruction::OP_INPUT:
-		stack.push(input_number());
+		print_number(stack[reg.SP--]);
 		break;
+	case instruction::OP_INPUT: {
+		integer_t n = step_input();
+		stack[++reg.SP] = n;
+		break; }
 	case instruction::OP_PUSH:
 		if (mode == 0x01) {
-			stack.push(ins.operand[0]);
+			stack[++reg.SP] = ins.operand[0];
 		} else {
-			if (!vars[ins.operand[0]])
+			if (!vars.is_defined(ins.operand[0]))
 				throw error::variable_not_defined();
-			stack.push(*vars[ins.operand[0]]);
+			stack[++reg.SP] = vars.value[ins.operand[0]];
 		}
 		break;
 	case instruction::OP_POP:
-		vars[ins.operand[0]] = stack.top();
-		stack.pop();
+		vars.set(ins.operand[0], stack[reg.SP--]);
+		break;
+	case instruction::OP_STORE:
+		vars.set(ins.operand[0], stack[reg.SP]);
 		break;
 	case instruction::OP_ADD: {
-		integer_t n = stack.top();
-		stack.pop();
-		stack.top() += n;
+		integer_t n = stack[reg.SP--];
+		stack[reg.SP] = wrapping_add(stack[reg.SP], n);
 		break; }
 	case instruction::OP_SUB: {
-		integer_t n = stack.top();
-		stack.pop();
-		stack.top() -= n;
+		integer_t n = stack[reg.SP--];
+		stack[reg.SP] = wrapping_sub(stack[reg.SP], n);
 		break; }
 	case instruction::OP_MUL: {
-		integer_t n = stack.top();
-		stack.pop();
-		stack.top() *= n;
+		integer_t n = stack[reg.SP--];
+		stack[reg.SP] = wrapping_mul(stack[reg.SP], n);
 		break; }
 	case instruction::OP_DIV: {
-		integer_t n = stack.top();
+		integer_t n = stack[reg.SP];
 		if (n == 0)
 			throw error::divided_by_zero();
-		stack.pop();
-		stack.top() /= n;
+		--reg.SP;
+		stack[reg.SP] /= n;
 		break; }
 	case instruction::OP_JMP:
 		reg.PC = ins.operand[0];
 		break;
 	case instruction::OP_JZ: {
-		integer_t n = stack.top();
-		stack.pop();
+		integer_t n = stack[reg.SP--];
+		COUNT_BRANCH(n == 0);
 		if (n == 0)
 			reg.PC = ins.operand[0];
 		break; }
 	case instruction::OP_JP: {
-		integer_t n = stack.top();
-		stack.pop();
+		integer_t n = stack[reg.SP--];
+		COUNT_BRANCH(n > 0);
 		if (n > 0)
 			reg.PC = ins.operand[0];
 		break; }
+	case instruction::OP_JNZ: {
+		integer_t n = stack[reg.SP--];
+		COUNT_BRANCH(n != 0);
+		if (n != 0)
+			reg.PC = ins.operand[0];
+		break; }
+	case instruction::OP_JNP: {
+		integer_t n = stack[reg.SP--];
+		COUNT_BRANCH(n <= 0);
+		if (n <= 0)
+			reg.PC = ins.operand[0];
+		break; }
 	default:
 		assert(0);
 	}
 	return;
 }
 
+void machine::step_register(const instruction& ins)
+{
+	switch (ins.op_lo >> 4) {
+	case instruction::OP_INT:
+		fetch(ins, 1);
+		fetch(ins, 2);
+		assert(ins.operand[0] == 0xff);
+		throw error::line_number_error();
+	case instruction::OP_PRINT:
+		print_number(fetch(ins, 0));
+		break;
+	case instruction::OP_INPUT:
+		vars.set(ins.operand[0], step_input());
+		break;
+	case instruction::OP_MOV:
+		vars.set(ins.operand[0], fetch(ins, 1));
+		break;
+	case instruction::OP_ADD: {
+		integer_t a = fetch(ins, 1);
+		integer_t b = fetch(ins, 2);
+		vars.set(ins.operand[0], wrapping_add(a, b));
+		break; }
+	case instruction::OP_SUB: {
+		integer_t a = fetch(ins, 1);
+		integer_t b = fetch(ins, 2);
+		vars.set(ins.operand[0], wrapping_sub(a, b));
+		break; }
+	case instruction::OP_MUL: {
+		integer_t a = fetch(ins, 1);
+		integer_t b = fetch(ins, 2);
+		vars.set(ins.operand[0], wrapping_mul(a, b));
+		break; }
+	case instruction::OP_DIV: {
+		integer_t a = fetch(ins, 1);
+		integer_t b = fetch(ins, 2);
+		if (b == 0)
+			throw error::divided_by_zero();
+		vars.set(ins.operand[0], a / b);
+		break; }
+	case instruction::OP_JZ: {
+		integer_t a = fetch(ins, 1);
+		integer_t b = fetch(ins, 2);
+		COUNT_BRANCH(wrapping_sub(a, b) == 0);
+		if (wrapping_sub(a, b) == 0)
+			reg.PC = ins.operand[0];
+		break; }
+	case instruction::OP_JP: {
+		integer_t a = fetch(ins, 1);
+		integer_t b = fetch(ins, 2);
+		COUNT_BRANCH(wrapping_sub(a, b) > 0);
+		if (wrapping_sub(a, b) > 0)
+			reg.PC = ins.operand[0];
+		break; }
+	case instruction::OP_JNZ: {
+		integer_t a = fetch(ins, 1);
+		integer_t b = fetch(ins, 2);
+		COUNT_BRANCH(wrapping_sub(a, b) != 0);
+		if (wrapping_sub(a, b) != 0)
+			reg.PC = ins.operand[0];
+		break; }
+	case instruction::OP_JNP: {
+		integer_t a = fetch(ins, 1);
+		integer_t b = fetch(ins, 2);
+		COUNT_BRANCH(wrapping_sub(a, b) <= 0);
+		if (wrapping_sub(a, b) <= 0)
+			reg.PC = ins.operand[0];
+		break; }
+	default:
+		assert(0);
+	}
+}
+
+#undef COUNT_BRANCH
+
+// input_number() for step(), which has moved reg.PC past the INPUT already.
+integer_t machine::step_input()
+{
+	try {
+		return input_number();
+	} catch (input_wanted&) {
+		--reg.PC;
+		throw;
+	}
+}
+
+// Source operand i of an instruction in three-address form.
+integer_t machine::fetch(const instruction& ins, int i)
+{
+	if (operand_mode(ins, i) != 2)
+		return ins.operand[i];
+	if (!vars.is_defined(ins.operand[i]))
+		throw error::variable_not_defined();
+	return vars.value[ins.operand[i]];
+}
+
 void machine::clear()
 {
-	var_map.clear();
 	vars.clear();
+	traces = trace_cache_t();
+	_profile = profile_t();
 	stack = stack_t();
-	reg.PC = reg.STEP = reg.STOP = 0;
+	reg.PC = reg.STEP = reg.STOP = reg.SP = 0;
 }
 
 } // namespace BASIC
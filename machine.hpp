@@ -4,35 +4,215 @@
 #include "common.hpp"
 
 #include "instruction.hpp"
+#include "perf.hpp"
+#include "program.hpp"
 
 namespace BASIC {
 
+struct jit_frame;
+
 class machine {
+public:
+	enum engine_type {
+		// switch on every instruction in step()
+		ENGINE_SWITCH,
+		// pre-decoded direct-threaded code with computed goto
+		ENGINE_THREADED,
+		// the handlers of ENGINE_THREADED over 8/16-byte compact code
+		ENGINE_COMPACT,
+		// x86-64 code compiled from binary code
+		ENGINE_JIT,
+		// a tree of callables for each statement
+		ENGINE_CLOSURE,
+		// ENGINE_SWITCH, with hot loops recorded into superblocks
+		ENGINE_TRACE,
+	};
+	enum run_status {
+		// stopped by HALT or at the end of the program
+		RUN_HALTED,
+		// stopped at an INPUT with no number yet, see input_wanted
+		RUN_WAITING,
+	};
+	// Thrown by input_number() if there is no number to read yet. The
+	// machine stops at the INPUT, and run() returns RUN_WAITING with all
+	// the state kept, so that resume() reads it again later.
+	struct input_wanted { };
+	// What a BASIC line cost while profiling, see set_profiling().
+	struct line_profile {
+		std::size_t lineno;
+		// times control came to its first instruction
+		std::uint64_t count;
+		// instructions run in it
+		std::uint64_t steps;
+		// time spent in it, waiting for input included
+		std::chrono::steady_clock::duration time;
+	};
+	// What the last run() or resume() cost, see set_stats().
+	struct run_stats {
+		std::chrono::steady_clock::duration time{};
+		// Instructions of binary code run. Only step() and the
+		// threaded engines count them.
+		std_optional<std::uint64_t> steps;
+		// the bound on the depth of the operand stack that the
+		// linker computed, not the depth reached by the run
+		std::size_t stack_bound = 0;
+		// of the thread running it, where available
+		perf_counters::values_t counters;
+	};
 private:
-	using var_map_t = std::unordered_map<std::string, integer_t>;
-	using var_pool_t = std::vector<std_optional<integer_t>>;
-	using stack_t = std::stack<integer_t>;
-	var_map_t var_map;
+	// Values of the variable slots, with a bitmap of those defined.
+	struct var_pool_t {
+		std::vector<integer_t> value;
+		std::vector<std::uint64_t> defined;
+
+		std::size_t size() const
+		{
+			return value.size();
+		}
+		void resize(std::size_t n)
+		{
+			value.resize(n);
+			defined.resize((n + 63) / 64);
+		}
+		void clear()
+		{
+			value.clear();
+			defined.clear();
+		}
+		bool is_defined(integer_t i) const
+		{
+			return defined[i >> 6] >> (i & 63) & 1;
+		}
+		void set(integer_t i, integer_t n)
+		{
+			value[i] = n;
+			defined[i >> 6] |= std::uint64_t(1) << (i & 63);
+		}
+	};
+	// A flat operand stack, grown to the max depth of the program before
+	// it runs. stack[0] is a dummy slot, and stack[SP] is the top.
+	using stack_t = std::vector<integer_t>;
 	var_pool_t vars;
 	stack_t stack;
 	struct registers {
 		integer_t PC;
-		// unused currently
+		// instructions run, where the engine counts them
 		integer_t STEP;
 		integer_t STOP;
+		// depth of the operand stack
+		integer_t SP;
 	} reg;
+	engine_type _engine;
+	trace_cache_t traces;
+	bool _profiling;
+	struct profile_t {
+		// of the program profiled
+		std::uint64_t id = 0;
+		// each line with code, in order
+		std::vector<line_profile> lines;
+		// index into lines of the line of each instruction
+		std::vector<std::size_t> index;
+	} _profile;
+	// opened by set_stats(true)
+	std::unique_ptr<perf_counters> _perf;
+	run_stats _stats;
 	void step(const instruction& ins);
+	integer_t step_input();
+	void step_register(const instruction& ins);
+	integer_t fetch(const instruction& ins, int i);
+	void run_engine(const program& prog);
+	bool counts_steps() const;
+	void run_switch(const binary_code_t& prog);
+	// See closure.cpp.
+	struct closure_builder;
+	void prepare_closure(program& prog);
+	void run_closure(const program& prog);
+	void build_superblock(const binary_code_t& code,
+		const std::vector<integer_t>& path, superblock_t& sb);
+	// See trace.cpp.
+	void run_trace(const program& prog);
+	bool record_trace(const binary_code_t& code, superblock_t& sb);
+	void run_superblock(const superblock_t& sb);
+	// See profile.cpp.
+	void run_profiled(const program& prog);
+#ifdef BASIC_DISPATCH_STATS
+	// Counts of step() since run(), see dispatch_stats.cpp. Shared only
+	// because the type is incomplete here.
+	struct dispatch_stats;
+	std::shared_ptr<dispatch_stats> _dispatch;
+	void count_dispatch(const instruction& ins);
+	void count_branch(const instruction& ins, bool taken);
+	void dump_dispatch();
+	void reset_dispatch();
+#endif
+#ifdef BASIC_HAVE_COMPUTED_GOTO
+	// Run code of the given layout. Return the handler table if code is
+	// null. See threaded.cpp.
+	template<class Layout>
+	const void* const* run_threaded(const typename Layout::code_t* code);
+	void run_threaded(const program& prog);
+	void prepare_threaded(program& prog);
+	void prepare_compact(program& prog);
+#endif
+#ifdef BASIC_HAVE_JIT
+	// Callbacks of native code for PRINT and INPUT. See jit.cpp.
+	static bool jit_print(jit_frame* frame, integer_t n);
+	static bool jit_input(jit_frame* frame);
+	void prepare_jit(program& prog);
+	void run_jit(const program& prog);
+#endif
 protected:
 	// functions for input and print. Child classes should implement these.
 	virtual integer_t input_number() = 0;
 	virtual void print_number(integer_t) = 0;
 public:
-	void run(const binary_code_t& prog);
+	machine();
+	// Select the execution engine. Return false if it is not available.
+	bool set_engine(engine_type engine);
+	engine_type engine() const
+	{
+		return _engine;
+	}
+	static const char* engine_name(engine_type engine);
+	// While profiling, programs run on step() as in the switch engine,
+	// whatever the engine selected, counting what each line costs. run()
+	// starts a new profile, and resume() adds to it.
+	void set_profiling(bool profiling)
+	{
+		_profiling = profiling;
+	}
+	const std::vector<line_profile>& profile() const
+	{
+		return _profile.lines;
+	}
+	// Measure every run() and resume(), with hardware counters if
+	// perf_counters has any. Off by default.
+	void set_stats(bool stats);
+	bool stats_enabled() const
+	{
+		return static_cast<bool>(_perf);
+	}
+	const run_stats& stats() const
+	{
+		return _stats;
+	}
+	// Prepare a linked program for the selected engine. Call it once after
+	// linking; it does nothing if the program is already prepared.
+	void prepare(program& prog);
+	run_status run(const program& prog);
+	// run(), and then put the registers and the profile back as they
+	// were, however it ends, so that resume() goes on with the program
+	// that ran before. For statements typed at the console.
+	run_status run_aside(const program& prog);
+	// Go on running a program from where run() or resume() returned: the
+	// INPUT it waits at, or what follows the HALT it stopped at.
+	run_status resume(const program& prog);
+	// Write the state of the machine, for load_state() to restore with
+	// the same program later. See state.cpp.
+	void save_state(std::ostream& os, const program& prog) const;
+	void load_state(std::istream& is, const program& prog);
 	void clear();
 	virtual ~machine() = default;
-
-	// linker modifies variable maps.
-	friend class linker;
 };
 
 } // namespace BASIC
@@ -0,0 +1,1310 @@
+#include "optimizer.hpp"
+
+#include "cfg.hpp"
+
+namespace BASIC {
+
+namespace {
+
+// What an operand on the stack of fold_constants() is known to be. Its
+// tokens are those from begin on in the output.
+struct folded_operand {
+	enum {
+		OTHER,
+		CONSTANT,
+		// some x, then an IMMEDIATE and a + or -
+		ADD_CONSTANT,
+		// some x, then an IMMEDIATE and a *
+		MUL_CONSTANT,
+	} kind;
+	std::size_t begin;
+	// the constant, or what x is added to or multiplied by
+	integer_t value;
+};
+
+expr_token immediate(integer_t n)
+{
+	expr_token token;
+	token.type = expr_token::IMMEDIATE;
+	token.num = n;
+	return token;
+}
+
+expr_token operator_token(char op)
+{
+	expr_token token;
+	token.type = expr_token::OPERATOR;
+	token.str.push_back(op);
+	return token;
+}
+
+// a op b as the machine computes it, or nothing if it traps or is undefined
+std_optional<integer_t> evaluate(char op, integer_t a, integer_t b)
+{
+	switch (op) {
+	case '+':
+		return wrapping_add(a, b);
+	case '-':
+		return wrapping_sub(a, b);
+	case '*':
+		return wrapping_mul(a, b);
+	case '/':
+		if (b == 0 || (a == INT64_MIN && b == -1))
+			return std_nullopt;
+		return a / b;
+	default:
+		assert(0);
+	}
+	return std_nullopt;
+}
+
+// Make the tokens at the end of out, after x, add c to x. With c == 0, they
+// are dropped.
+void set_added(expr_t& out, integer_t c)
+{
+	out.resize(out.size() - 2);
+	if (c == 0)
+		return;
+	if (c < 0 && c != INT64_MIN) {
+		out.push_back(immediate(-c));
+		out.push_back(operator_token('-'));
+	} else {
+		out.push_back(immediate(c));
+		out.push_back(operator_token('+'));
+	}
+}
+
+} // namespace
+
+// The expression is rebuilt from RPN left to right, with the operands of
+// the rebuilt one on a stack. Constants have no effect when evaluated, so
+// they may move: C + X becomes X + C, for the constant to merge later on.
+void fold_constants(expr_t& expr)
+{
+	expr_t out;
+	std::vector<folded_operand> vals;
+	for (auto& token : expr) {
+		switch (token.type) {
+		case expr_token::IMMEDIATE:
+			vals.push_back({folded_operand::CONSTANT, out.size(),
+				token.num});
+			out.push_back(token);
+			continue;
+		case expr_token::VARIABLE:
+			vals.push_back({folded_operand::OTHER, out.size(), 0});
+			out.push_back(token);
+			continue;
+		case expr_token::OPERATOR:
+			break;
+		default:
+			assert(0);
+		}
+		char op = token.str[0];
+		auto b = vals.back();
+		vals.pop_back();
+		auto a = vals.back();
+		vals.pop_back();
+		if (a.kind == folded_operand::CONSTANT &&
+				b.kind == folded_operand::CONSTANT) {
+			auto n = evaluate(op, a.value, b.value);
+			if (n) {
+				out.resize(a.begin);
+				vals.push_back({folded_operand::CONSTANT,
+					a.begin, *n});
+				out.push_back(immediate(*n));
+				continue;
+			}
+		}
+		if ((op == '+' || op == '*') &&
+				a.kind == folded_operand::CONSTANT &&
+				b.kind != folded_operand::CONSTANT) {
+			// the constant goes after the other operand
+			out.erase(out.begin() + a.begin);
+			b.begin = a.begin;
+			std::swap(a, b);
+			b.begin = out.size();
+			out.push_back(immediate(b.value));
+		}
+		if (b.kind != folded_operand::CONSTANT) {
+			vals.push_back({folded_operand::OTHER, a.begin, 0});
+			out.push_back(token);
+			continue;
+		}
+		// x op C
+		auto c = b.value;
+		switch (op) {
+		case '-':
+			c = wrapping_sub(0, c);
+			// fall through
+		case '+':
+			if (a.kind == folded_operand::ADD_CONSTANT) {
+				out.pop_back();
+				c = wrapping_add(a.value, c);
+				set_added(out, c);
+				a.kind = c ? folded_operand::ADD_CONSTANT :
+					folded_operand::OTHER;
+				a.value = c;
+				vals.push_back(a);
+			} else if (c == 0) {
+				out.pop_back();
+				vals.push_back(a);
+			} else {
+				out.push_back(token);
+				vals.push_back({folded_operand::ADD_CONSTANT,
+					a.begin, c});
+			}
+			break;
+		case '*':
+			if (a.kind == folded_operand::MUL_CONSTANT) {
+				out.pop_back();
+				c = wrapping_mul(a.value, c);
+				if (c == 1) {
+					out.resize(out.size() - 2);
+					a.kind = folded_operand::OTHER;
+				} else {
+					out[out.size() - 2].num = c;
+				}
+				a.value = c;
+				vals.push_back(a);
+			} else if (c == 1) {
+				out.pop_back();
+				vals.push_back(a);
+			} else {
+				out.push_back(token);
+				vals.push_back({folded_operand::MUL_CONSTANT,
+					a.begin, c});
+			}
+			break;
+		case '/':
+			if (c == 1) {
+				out.pop_back();
+				vals.push_back(a);
+			} else {
+				out.push_back(token);
+				vals.push_back({folded_operand::OTHER, a.begin,
+					0});
+			}
+			break;
+		default:
+			assert(0);
+		}
+	}
+	expr = std::move(out);
+}
+
+void fold_constants(object_code_t& obj)
+{
+	for (auto& line : obj) {
+		fold_constants(line.second.expr);
+		fold_constants(line.second.expr2);
+	}
+}
+
+namespace {
+
+bool is_jump(const command& comm)
+{
+	return comm.type == command::BASIC_GOTO || comm.type == command::BASIC_IF;
+}
+
+// the line where code runs from after a jump to it, or end
+object_code_t::const_iterator landing(const object_code_t& obj,
+	object_code_t::const_iterator it)
+{
+	while (it != obj.end() && it->second.type == command::BASIC_REM)
+		++it;
+	return it;
+}
+
+// Whether an IF of two immediates jumps, as if_condition() tests them.
+bool constant_condition(const command& comm)
+{
+	auto l = comm.expr[0].num;
+	auto r = comm.expr2[0].num;
+	if (comm.cmp == "=")
+		return wrapping_sub(l, r) == 0;
+	if (comm.cmp == ">")
+		return wrapping_sub(l, r) > 0;
+	return wrapping_sub(r, l) > 0;
+}
+
+} // namespace
+
+// An IF to a missing line traps even if its condition is false, so only IFs
+// to lines that exist are decided.
+void thread_jumps(object_code_t& obj)
+{
+	for (auto& line : obj) {
+		auto& a = line.second;
+		if (a.type != command::BASIC_IF || a.expr.size() != 1 ||
+				a.expr2.size() != 1 ||
+				a.expr[0].type != expr_token::IMMEDIATE ||
+				a.expr2[0].type != expr_token::IMMEDIATE ||
+				!obj.count(a.target_lineno))
+			continue;
+		auto lineno = a.target_lineno;
+		bool taken = constant_condition(a);
+		a.clear();
+		a.type = taken ? command::BASIC_GOTO : command::BASIC_REM;
+		a.target_lineno = lineno;
+	}
+	for (auto& line : obj) {
+		auto& a = line.second;
+		if (!is_jump(a))
+			continue;
+		// follow GOTOs, while they go to lines that exist, and not round
+		std::unordered_set<std::size_t> seen;
+		object_code_t::const_iterator target = obj.find(a.target_lineno);
+		while (target != obj.end()) {
+			auto land = landing(obj, target);
+			if (land == obj.end())
+				break;
+			target = land;
+			if (land->second.type != command::BASIC_GOTO ||
+					!seen.insert(land->first).second)
+				break;
+			auto next = obj.find(land->second.target_lineno);
+			if (next == obj.end())
+				break;
+			target = next;
+		}
+		if (target != obj.end())
+			a.target_lineno = target->first;
+	}
+}
+
+void drop_unreachable(object_code_t& obj)
+{
+	std::vector<object_code_t::iterator> lines;
+	std::vector<std::size_t> linenos;
+	for (auto it = obj.begin(); it != obj.end(); ++it) {
+		lines.push_back(it);
+		linenos.push_back(it->first);
+	}
+	std::vector<bool> reached(lines.size());
+	std::vector<std::size_t> work;
+	auto reach = [&](std::size_t i) {
+		if (i < lines.size() && !reached[i]) {
+			reached[i] = true;
+			work.push_back(i);
+		}
+	};
+	reach(0);
+	while (!work.empty()) {
+		auto i = work.back();
+		work.pop_back();
+		auto& a = lines[i]->second;
+		if (is_jump(a)) {
+			auto t = std::lower_bound(linenos.begin(), linenos.end(),
+				a.target_lineno);
+			if (t != linenos.end() && *t == a.target_lineno)
+				reach(t - linenos.begin());
+		}
+		if (a.type != command::BASIC_GOTO)
+			reach(i + 1);
+	}
+	for (std::size_t i = 0; i < lines.size(); ++i)
+		if (!reached[i])
+			obj.erase(lines[i]);
+	for (auto it = obj.begin(); it != obj.end(); ++it) {
+		auto& a = it->second;
+		if (a.type != command::BASIC_GOTO)
+			continue;
+		auto target = obj.find(a.target_lineno);
+		if (target != obj.end() && landing(obj, std::next(it)) ==
+				landing(obj, target))
+			a.clear();
+	}
+}
+
+// Dataflow over the whole program needs a set of variables per block. If
+// that would take more words than this, each block is on its own, with no
+// variable known to be defined at its start and all live at its end.
+constexpr std::size_t DATAFLOW_MAX_WORDS = 1 << 20;
+
+// Dropping a LET may leave the variables it read dead before it, so it is
+// done again until nothing more is dropped.
+void eliminate_dead_stores(object_code_t& obj)
+{
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		control_flow_graph cfg(obj);
+		auto& blocks = cfg.blocks();
+		bool global = blocks.size() * ((cfg.nvars() + 63) / 64) <=
+			DATAFLOW_MAX_WORDS;
+		std::vector<var_set> defined, live;
+		if (global) {
+			defined = cfg.defined();
+			live = cfg.live(defined);
+		}
+		std::vector<bool> stops;
+		for (std::size_t b = 0; b < blocks.size(); ++b) {
+			auto& lines = blocks[b].lines;
+			auto d = global ? defined[b] : cfg.empty_set();
+			stops.resize(lines.size());
+			for (std::size_t i = 0; i < lines.size(); ++i) {
+				stops[i] = cfg.may_stop(*lines[i], d);
+				cfg.defined_after(*lines[i], d);
+			}
+			auto l = global ? live[b] : cfg.visible();
+			for (std::size_t i = lines.size(); i-- > 0; ) {
+				auto& a = lines[i]->second;
+				if (a.type == command::BASIC_LET && !stops[i] &&
+						!l.test(cfg.var(a.target_var))) {
+					a.clear();
+					changed = true;
+					continue;
+				}
+				cfg.live_before(*lines[i], stops[i], l);
+			}
+		}
+	}
+}
+
+// The IF at the top is copied to the bottom, where nothing runs between
+// the GOTO and it, so the copy sees the same values and traps alike.
+void invert_loops(object_code_t& obj, line_notes_t& notes)
+{
+	for (auto it = obj.begin(); it != obj.end(); ++it) {
+		auto& a = it->second;
+		if (a.type != command::BASIC_GOTO || a.target_lineno > it->first)
+			continue;
+		auto top = obj.find(a.target_lineno);
+		if (top == obj.end() || top->second.type != command::BASIC_IF)
+			continue;
+		auto exit = obj.find(top->second.target_lineno);
+		if (exit == obj.end() || landing(obj, exit) !=
+				landing(obj, std::next(it)))
+			continue;
+		auto t = notes.find(top->first);
+		line_notes bottom;
+		bottom.negated = !(t != notes.end() && t->second.negated);
+		notes[it->first] = std::move(bottom);
+		a = top->second;
+		a.target_lineno = std::next(top)->first;
+	}
+}
+
+namespace {
+
+// The least and the greatest element of any range of a sequence, from
+// tables of those of the ranges of 2^k elements.
+class range_bounds {
+public:
+	explicit range_bounds(const std::vector<std::size_t>& v):
+		mins(1, v),
+		maxs(1, v)
+	{
+		for (std::size_t k = 1; std::size_t(1) << k <= v.size(); ++k) {
+			auto half = std::size_t(1) << (k - 1);
+			auto n = v.size() - (half << 1) + 1;
+			mins.emplace_back(n);
+			maxs.emplace_back(n);
+			for (std::size_t i = 0; i < n; ++i) {
+				mins[k][i] = std::min(mins[k - 1][i],
+					mins[k - 1][i + half]);
+				maxs[k][i] = std::max(maxs[k - 1][i],
+					maxs[k - 1][i + half]);
+			}
+		}
+	}
+	// of [first, last), which is not empty
+	std::pair<std::size_t, std::size_t> get(std::size_t first,
+		std::size_t last) const
+	{
+		std::size_t k = 0;
+		while (std::size_t(2) << k <= last - first)
+			++k;
+		auto second = last - (std::size_t(1) << k);
+		return {std::min(mins[k][first], mins[k][second]),
+			std::max(maxs[k][first], maxs[k][second])};
+	}
+
+private:
+	std::vector<std::vector<std::size_t>> mins;
+	std::vector<std::vector<std::size_t>> maxs;
+};
+
+// The tokens of expr from first to last as a string, the same for equal
+// subexpressions.
+std::string subexpr_key(const expr_t& expr, std::size_t first,
+	std::size_t last)
+{
+	std::string key;
+	for (auto i = first; i <= last; ++i) {
+		auto& token = expr[i];
+		if (token.type == expr_token::IMMEDIATE)
+			key += std::to_string(token.num);
+		else
+			key += token.str;
+		key += token.type == expr_token::VARIABLE ? '$' : ' ';
+	}
+	return key;
+}
+
+// Replace the largest subexpressions with operators that invariant() holds
+// for by hidden variables, which the LETs added to hoisted compute. Those of
+// equal ones are shared through temps.
+class loop_hoister {
+public:
+	loop_hoister(std::function<bool(const std::string&)> invariant,
+			std::vector<command>& hoisted, int& ntemps):
+		invariant(std::move(invariant)),
+		hoisted(hoisted),
+		ntemps(ntemps)
+	{ }
+	void hoist(expr_t& expr);
+
+private:
+	std::function<bool(const std::string&)> invariant;
+	std::vector<command>& hoisted;
+	int& ntemps;
+	std::unordered_map<std::string, std::string> temps;
+};
+
+// Hoisting must not make a trap happen where it would not, so a division is
+// only hoisted if by a constant other than 0, or -1, which overflows.
+void loop_hoister::hoist(expr_t& expr)
+{
+	auto n = expr.size();
+	for (auto& token : expr)
+		if (token.type == expr_token::SAVE)
+			return;
+	// first token, parent, or n for the root, and whether it may be
+	// hoisted, by last token
+	std::vector<std::size_t> first(n), parent(n, n);
+	std::vector<bool> ok(n);
+	std::vector<std::size_t> stack;
+	for (std::size_t i = 0; i < n; ++i) {
+		auto& token = expr[i];
+		first[i] = i;
+		if (token.type == expr_token::IMMEDIATE) {
+			ok[i] = true;
+		} else if (token.type == expr_token::VARIABLE) {
+			ok[i] = invariant(token.str);
+		} else {
+			auto b = stack.back();
+			stack.pop_back();
+			auto a = stack.back();
+			stack.pop_back();
+			first[i] = first[a];
+			parent[a] = parent[b] = i;
+			ok[i] = ok[a] && ok[b] && (token.str[0] != '/' ||
+				(expr[b].type == expr_token::IMMEDIATE &&
+				expr[b].num != 0 && expr[b].num != -1));
+		}
+		stack.push_back(i);
+	}
+	// the last token of each subexpression to hoist, by its first one
+	std::unordered_map<std::size_t, std::size_t> roots;
+	for (std::size_t i = 0; i < n; ++i)
+		if (ok[i] && expr[i].type == expr_token::OPERATOR &&
+				(parent[i] == n || !ok[parent[i]]))
+			roots[first[i]] = i;
+	if (roots.empty())
+		return;
+	expr_t out;
+	for (std::size_t i = 0; i < n; ++i) {
+		auto root = roots.find(i);
+		if (root == roots.end()) {
+			out.push_back(std::move(expr[i]));
+			continue;
+		}
+		auto key = subexpr_key(expr, i, root->second);
+		auto& temp = temps[key];
+		if (temp.empty()) {
+			temp = "~L" + std::to_string(ntemps++);
+			command let;
+			let.type = command::BASIC_LET;
+			let.target_var = temp;
+			let.expr.assign(expr.begin() + i,
+				expr.begin() + root->second + 1);
+			hoisted.push_back(std::move(let));
+		}
+		expr_token var;
+		var.type = expr_token::VARIABLE;
+		var.str = temp;
+		var.num = 0;
+		out.push_back(std::move(var));
+		i = root->second;
+	}
+	expr = std::move(out);
+}
+
+} // namespace
+
+// A loop is taken to be the lines from a head to the last backward jump to
+// it. Its hoisted LETs go to the head, and run when it is entered, before
+// its first iteration. So it is left alone unless nothing jumps into the
+// rest of it from outside.
+//
+// A subexpression is invariant if it reads no variable that the loop
+// assigns, and hidden ones, which the hoisted LETs of inner loops may
+// assign. It is hoisted only if it cannot trap: every variable it reads is
+// defined on every path to the head, and it divides by no variable.
+void hoist_invariants(object_code_t& obj, line_notes_t& notes)
+{
+	control_flow_graph cfg(obj, &notes);
+	auto& blocks = cfg.blocks();
+	if (blocks.size() * ((cfg.nvars() + 63) / 64) > DATAFLOW_MAX_WORDS)
+		return;
+	auto defined = cfg.defined();
+	std::unordered_map<std::size_t, std::size_t> block_at;
+	for (std::size_t b = 0; b < blocks.size(); ++b)
+		block_at[blocks[b].lines[0]->first] = b;
+
+	// jumps to lines that exist, by their targets, and loops by heads
+	std::vector<std::pair<std::size_t, std::size_t>> jumps;
+	std::map<std::size_t, std::size_t> loops;
+	for (auto& line : obj) {
+		auto& a = line.second;
+		if (!is_jump(a) || !obj.count(a.target_lineno))
+			continue;
+		jumps.emplace_back(a.target_lineno, line.first);
+		if (a.target_lineno <= line.first) {
+			auto& last = loops[a.target_lineno];
+			last = std::max(last, line.first);
+		}
+	}
+	if (loops.empty())
+		return;
+	std::sort(jumps.begin(), jumps.end());
+	std::vector<std::size_t> sources;
+	for (auto& j : jumps)
+		sources.push_back(j.second);
+	range_bounds from(sources);
+
+	// inner loops first, so that outer ones hoist from their LETs too
+	std::vector<std::pair<std::size_t, std::size_t>> order(loops.begin(),
+		loops.end());
+	std::stable_sort(order.begin(), order.end(),
+		[](const std::pair<std::size_t, std::size_t>& x,
+				const std::pair<std::size_t, std::size_t>& y) {
+			return x.second - x.first < y.second - y.first;
+		});
+	int ntemps = 0;
+	for (auto& loop : order) {
+		auto head = loop.first;
+		auto last = loop.second;
+		auto inside = std::upper_bound(jumps.begin(), jumps.end(),
+			std::make_pair(head, SIZE_MAX)) - jumps.begin();
+		auto end = std::upper_bound(jumps.begin(), jumps.end(),
+			std::make_pair(last, SIZE_MAX)) - jumps.begin();
+		if (inside < end) {
+			auto b = from.get(inside, end);
+			if (b.first < head || b.second > last)
+				continue;
+		}
+
+		auto begin = obj.find(head);
+		auto stop = obj.upper_bound(last);
+		std::unordered_set<std::string> assigned;
+		for (auto it = begin; it != stop; ++it) {
+			auto& a = it->second;
+			if (a.type == command::BASIC_LET ||
+					a.type == command::BASIC_INPUT)
+				assigned.insert(a.target_var);
+		}
+		auto& d = defined[block_at.at(head)];
+		auto invariant = [&](const std::string& name) {
+			return name[0] != '~' && !assigned.count(name) &&
+				d.test(cfg.var(name));
+		};
+		std::vector<command> hoisted;
+		loop_hoister h(invariant, hoisted, ntemps);
+		for (auto it = begin; it != stop; ++it) {
+			auto& a = it->second;
+			auto n = notes.find(it->first);
+			if (n != notes.end())
+				for (auto& l : n->second.hoisted)
+					h.hoist(l.expr);
+			h.hoist(a.expr);
+			h.hoist(a.expr2);
+		}
+		if (hoisted.empty())
+			continue;
+		notes[head].hoisted = std::move(hoisted);
+		for (auto it = begin; it != stop; ++it)
+			if (is_jump(it->second) && it->second.target_lineno == head)
+				notes[it->first].past_hoisted = true;
+	}
+}
+
+namespace {
+
+// A value kv * V + ki * I + a, where V is the variable a LET of a loop of
+// close_loops() assigns and I its counter. ki and a are expressions of
+// invariants, and empty ones are 0.
+struct affine {
+	integer_t kv;
+	expr_t ki;
+	expr_t a;
+};
+
+// x op y, where empty expressions are 0
+expr_t combine(expr_t x, const expr_t& y, char op)
+{
+	if (op == '*' && (x.empty() || y.empty()))
+		return expr_t();
+	if (y.empty())
+		return x;
+	if (x.empty()) {
+		if (op == '+')
+			return y;
+		x.push_back(immediate(0));
+	}
+	x.insert(x.end(), y.begin(), y.end());
+	x.push_back(operator_token(op));
+	return x;
+}
+
+expr_t variable(const std::string& name)
+{
+	expr_token token;
+	token.type = expr_token::VARIABLE;
+	token.str = name;
+	token.num = 0;
+	return {token};
+}
+
+bool is_immediate(const expr_t& expr)
+{
+	return expr.size() == 1 && expr[0].type == expr_token::IMMEDIATE;
+}
+
+// The affine form of an expression in a LET to var, or nothing if it has
+// none. Every variable it reads but var and counter must be invariant. As
+// in loop_hoister::hoist(), a division must be of invariants, by a constant
+// other than 0 and -1.
+std_optional<affine> affine_form(const expr_t& expr, const std::string& var,
+	const std::string& counter,
+	const std::function<bool(const std::string&)>& invariant)
+{
+	std::vector<affine> vals;
+	for (auto& token : expr) {
+		switch (token.type) {
+		case expr_token::IMMEDIATE:
+			vals.push_back({0, expr_t(), expr_t{token}});
+			continue;
+		case expr_token::VARIABLE:
+			if (token.str == var)
+				vals.push_back({1, expr_t(), expr_t()});
+			else if (token.str == counter)
+				vals.push_back({0, expr_t{immediate(1)}, expr_t()});
+			else if (invariant(token.str))
+				vals.push_back({0, expr_t(), expr_t{token}});
+			else
+				return std_nullopt;
+			continue;
+		case expr_token::OPERATOR:
+			break;
+		default:
+			return std_nullopt;
+		}
+		auto y = std::move(vals.back());
+		vals.pop_back();
+		auto& x = vals.back();
+		char op = token.str[0];
+		auto pure = [](const affine& z) {
+			return z.kv == 0 && z.ki.empty();
+		};
+		switch (op) {
+		case '+':
+		case '-':
+			x.kv = op == '+' ? wrapping_add(x.kv, y.kv) :
+				wrapping_sub(x.kv, y.kv);
+			x.ki = combine(std::move(x.ki), y.ki, op);
+			x.a = combine(std::move(x.a), y.a, op);
+			break;
+		case '*':
+			if (!pure(x))
+				std::swap(x, y);
+			if (!pure(x))
+				return std_nullopt;
+			// y * x, where V may only be multiplied by a constant
+			if (y.kv != 0) {
+				if (x.a.empty())
+					y.kv = 0;
+				else if (is_immediate(x.a))
+					y.kv = wrapping_mul(y.kv, x.a[0].num);
+				else
+					return std_nullopt;
+			}
+			y.ki = combine(std::move(y.ki), x.a, '*');
+			y.a = combine(std::move(y.a), x.a, '*');
+			x = std::move(y);
+			break;
+		case '/':
+			if (!pure(x) || !pure(y) || !is_immediate(y.a) ||
+					y.a[0].num == 0 || y.a[0].num == -1)
+				return std_nullopt;
+			if (!x.a.empty())
+				x.a = combine(std::move(x.a), y.a, '/');
+			break;
+		default:
+			assert(0);
+		}
+	}
+	return std::move(vals.back());
+}
+
+// c * x, for c 1 or -1
+expr_t times_step(expr_t x, integer_t c)
+{
+	return c > 0 ? x : combine(expr_t(), x, '-');
+}
+
+using loop_lets = std::map<std::string, object_code_t::iterator>;
+
+// Whether the lines from head to the IF at bottom that jumps back to it are
+// all LETs, one per variable, into lets, that nothing jumps into but at
+// head, and the IF compares a variable they assign. targets has the lines
+// that jumps go to.
+bool find_loop_lets(object_code_t::iterator head,
+	object_code_t::iterator bottom,
+	const std::unordered_set<std::size_t>& targets,
+	const line_notes_t& notes, loop_lets& lets)
+{
+	for (auto it = head; it != bottom; ++it) {
+		auto& a = it->second;
+		auto n = notes.find(it->first);
+		if ((a.type != command::BASIC_LET &&
+				a.type != command::BASIC_REM) ||
+				(n != notes.end() && n->second.count))
+			return false;
+		if (it != head && (targets.count(it->first) ||
+				(n != notes.end() && !n->second.hoisted.empty())))
+			return false;
+		if (a.type == command::BASIC_LET &&
+				!lets.emplace(a.target_var, it).second)
+			return false;
+	}
+	if (targets.count(bottom->first))
+		return false;
+	for (auto expr : {&bottom->second.expr, &bottom->second.expr2})
+		if (expr->size() == 1 &&
+				(*expr)[0].type == expr_token::VARIABLE &&
+				lets.count((*expr)[0].str))
+			return true;
+	return false;
+}
+
+// Close the loop of find_loop_lets(), if it has the shape close_loops()
+// takes. d has the variables defined at the head.
+void close_loop(object_code_t::iterator head, object_code_t::iterator bottom,
+	loop_lets& lets, line_notes_t& notes, const control_flow_graph& cfg,
+	const var_set& d, int& ntemps)
+{
+	std::size_t nlines = std::distance(head, bottom);
+	std::unordered_set<std::string> hoisted;
+	auto hn = notes.find(head->first);
+	if (hn != notes.end())
+		for (auto& h : hn->second.hoisted)
+			hoisted.insert(h.target_var);
+	// Every variable read must be defined, so that nothing traps.
+	auto defined = [&](const std::string& name) {
+		return hoisted.count(name) || d.test(cfg.var(name));
+	};
+	auto invariant = [&](const std::string& name) {
+		return !lets.count(name) && defined(name);
+	};
+
+	// diff = p - q, with the counter alone in p if sign is 1, or in q
+	auto& test = bottom->second;
+	auto p = &test.expr;
+	auto q = &test.expr2;
+	if (test.cmp == "<")
+		std::swap(p, q);
+	auto assigned_alone = [&](const expr_t* e) {
+		return e->size() == 1 && (*e)[0].type == expr_token::VARIABLE &&
+			lets.count((*e)[0].str);
+	};
+	integer_t sign = 1;
+	if (!assigned_alone(p)) {
+		std::swap(p, q);
+		sign = -1;
+	}
+	if (!assigned_alone(p))
+		return;
+	auto counter = (*p)[0].str;
+	if (!defined(counter))
+		return;
+	auto bound = affine_form(*q, "", counter, invariant);
+	if (!bound || bound->kv != 0 || !bound->ki.empty())
+		return;
+	auto step = affine_form(lets[counter]->second.expr, counter, "",
+		invariant);
+	if (!step || step->kv != 1)
+		return;
+	fold_constants(step->a);
+	if (!is_immediate(step->a) || (step->a[0].num != 1 &&
+			step->a[0].num != -1))
+		return;
+	integer_t c = step->a[0].num;
+
+	// The forms of the other LETs: a sum of V, or V not read
+	std::vector<std::pair<object_code_t::iterator, affine>> forms;
+	for (auto& let : lets) {
+		if (let.first == counter)
+			continue;
+		auto f = affine_form(let.second->second.expr, let.first,
+			counter, invariant);
+		if (!f || (f->kv != 0 && f->kv != 1))
+			return;
+		for (auto& token : let.second->second.expr)
+			if (token.str == let.first && !defined(let.first))
+				return;
+		forms.emplace_back(let.second, std::move(*f));
+	}
+	std::sort(forms.begin(), forms.end(),
+		[](const std::pair<object_code_t::iterator, affine>& x,
+				const std::pair<object_code_t::iterator, affine>& y) {
+			return x.first->first < y.first->first;
+		});
+
+	loop_count lc;
+	lc.test = test.cmp == "=" ? loop_count::ZERO : loop_count::POSITIVE;
+	auto t = notes.find(bottom->first);
+	lc.negated = t != notes.end() && t->second.negated;
+	lc.step = sign * c;
+	auto n = std::to_string(ntemps++);
+	lc.diff = "~D" + n;
+	lc.count = "~C" + n;
+	lc.triangle = "~T" + n;
+
+	// the difference the IF would see after the first iteration
+	auto advance = [&](const expr_t& expr) {
+		expr_t out;
+		for (auto& token : expr) {
+			out.push_back(token);
+			if (token.type == expr_token::VARIABLE &&
+					token.str == counter) {
+				out.push_back(immediate(1));
+				out.push_back(operator_token(c > 0 ? '+' : '-'));
+			}
+		}
+		return out;
+	};
+	command diff;
+	diff.type = command::BASIC_LET;
+	diff.target_var = lc.diff;
+	diff.expr = sign > 0 ? combine(advance(*p), advance(*q), '-') :
+		combine(advance(*q), advance(*p), '-');
+	fold_constants(diff.expr);
+
+	// The loop runs T = C + 1 times, and the counter is I + c * j before
+	// its LET in the iteration j from 0, and one step more after it.
+	auto I = variable(counter);
+	auto C = variable(lc.count);
+	auto T = combine(C, expr_t{immediate(1)}, '+');
+	std::vector<command> lets_after;
+	for (auto& f : forms) {
+		auto& form = f.second;
+		bool after = f.first->first > lets[counter]->first;
+		command let;
+		let.type = command::BASIC_LET;
+		let.target_var = f.first->second.target_var;
+		if (form.kv == 1) {
+			// sum over j of a + ki * (I + c * (j + after)), where
+			// the sum of j is the triangle
+			auto steps = combine(variable(lc.triangle),
+				after ? T : expr_t(), '+');
+			auto ki = combine(combine(T, I, '*'),
+				times_step(steps, c), '+');
+			let.expr = combine(variable(let.target_var),
+				combine(combine(T, form.a, '*'),
+				combine(form.ki, ki, '*'), '+'), '+');
+		} else {
+			// the value in the last iteration, j = C
+			auto steps = combine(C, after ?
+				expr_t{immediate(1)} : expr_t(), '+');
+			let.expr = combine(form.a, combine(form.ki,
+				combine(I, times_step(steps, c), '+'), '*'),
+				'+');
+			if (let.expr.empty())
+				let.expr.push_back(immediate(0));
+		}
+		fold_constants(let.expr);
+		lets_after.push_back(std::move(let));
+	}
+	command last;
+	last.type = command::BASIC_LET;
+	last.target_var = counter;
+	last.expr = combine(I, T, c > 0 ? '+' : '-');
+	fold_constants(last.expr);
+	lets_after.push_back(std::move(last));
+
+	auto& h = head->second;
+	h.clear();
+	h.type = command::BASIC_REM;
+	auto& note = notes[head->first];
+	note.hoisted.push_back(std::move(diff));
+	note.count = std::move(lc);
+	// there are as many lines after the head as in the loop before the IF
+	auto it = std::next(head);
+	for (std::size_t i = 0; i < nlines; ++i, ++it) {
+		notes.erase(it->first);
+		it->second.clear();
+		it->second.type = command::BASIC_REM;
+		if (i < lets_after.size())
+			it->second = std::move(lets_after[i]);
+	}
+}
+
+} // namespace
+
+// A loop here is the lines from a head to an IF that jumps back to it, all
+// LETs, that nothing jumps into but at its head. Its counter is the
+// variable on one side of the IF, which one LET adds 1 or -1 to, and the
+// other side must be invariant, as in hoist_invariants(). Each other LET
+// must either add an affine function of the counter to its variable, or
+// assign one, with coefficients that are invariant, and read no other
+// variable that the loop assigns. All the variables read must be defined
+// at the head, so that the loop cannot trap. The sums equal what the loop
+// leaves modulo 2^64, which relies on every engine wrapping ADD, SUB and MUL
+// around as wrapping_add() and the others do.
+void close_loops(object_code_t& obj, line_notes_t& notes)
+{
+	std::unordered_set<std::size_t> targets;
+	for (auto& line : obj)
+		if (is_jump(line.second))
+			targets.insert(line.second.target_lineno);
+	// Loops cannot overlap, as none has an IF but at its bottom.
+	struct loop {
+		object_code_t::iterator head;
+		object_code_t::iterator bottom;
+		loop_lets lets;
+	};
+	std::vector<loop> loops;
+	for (auto it = obj.begin(); it != obj.end(); ++it) {
+		auto& a = it->second;
+		if (a.type != command::BASIC_IF || a.target_lineno >= it->first)
+			continue;
+		auto head = obj.find(a.target_lineno);
+		loop_lets lets;
+		if (head != obj.end() &&
+				find_loop_lets(head, it, targets, notes, lets))
+			loops.push_back({head, it, std::move(lets)});
+	}
+	if (loops.empty())
+		return;
+
+	control_flow_graph cfg(obj, &notes);
+	auto& blocks = cfg.blocks();
+	if (blocks.size() * ((cfg.nvars() + 63) / 64) > DATAFLOW_MAX_WORDS)
+		return;
+	auto defined = cfg.defined();
+	std::unordered_map<std::size_t, std::size_t> block_at;
+	for (std::size_t b = 0; b < blocks.size(); ++b)
+		block_at[blocks[b].lines[0]->first] = b;
+
+	int ntemps = 0;
+	for (auto& loop : loops)
+		close_loop(loop.head, loop.bottom, loop.lets, notes, cfg,
+			defined[block_at.at(loop.head->first)], ntemps);
+}
+
+namespace {
+
+constexpr std::size_t NO_NODE = -1;
+
+// A subexpression of an expression of a run, the one that ends with its
+// token in RPN.
+struct vn_node {
+	// of an operator, the node of its left operand. The right one ends
+	// just before the operator.
+	std::size_t left = NO_NODE;
+	// value number
+	int vn;
+	// operators in the subexpression
+	int ops;
+	enum {
+		KEEP,
+		// evaluate it, and store the value in var
+		SAVE,
+		// read var instead
+		REUSE,
+	} use = KEEP;
+	std::string var;
+	// of a REUSE, the expression and node that SAVE the value, or NO_NODE
+	// if var already holds it
+	std::size_t from_expr;
+	std::size_t from = NO_NODE;
+};
+
+struct vn_expr {
+	expr_t* expr;
+	std::vector<vn_node> nodes;
+};
+
+// A line of a run: the expressions it evaluates, in that order, and the
+// variable it assigns, if any, with the value number of its new value.
+struct vn_line {
+	std::vector<std::size_t> exprs;
+	const std::string* target = nullptr;
+	int vn;
+};
+
+// The lines of a run are added one by one, and rewritten when it ends.
+class value_numbering {
+public:
+	void add(command& comm);
+	void finish();
+
+private:
+	std::vector<vn_expr> exprs;
+	std::vector<vn_line> lines;
+	int nvns = 0;
+	// whether some operator on values gets a value number it already had,
+	// without which there is nothing to reuse
+	bool repeated = false;
+	// value numbers of immediates ('#', number, 0) and of operators on
+	// two values (op, a, b)
+	std::map<std::tuple<char, integer_t, integer_t>, int> keys;
+	// those of variables as of the last line added
+	std::unordered_map<std::string, int> vars;
+	// how much evaluating the subexpressions of each value number that a
+	// SAVE provides would cost, summed over the nodes that REUSE them
+	std::unordered_map<int, int> gains;
+	// the same, where it is too little to be worth a SAVE
+	std::unordered_set<int> banned;
+	// while choosing uses, the first node to evaluate each value number,
+	// and the last variable assigned each one
+	std::unordered_map<int, std::pair<std::size_t, std::size_t>> avail;
+	std::unordered_map<int, std::string> holders;
+	std::unordered_map<std::string, int> now;
+
+	int key(char op, integer_t a, integer_t b);
+	void add_expr(expr_t& expr);
+	void reuse();
+	void choose_uses();
+	void visit(std::size_t e, std::size_t i);
+	void rewrite(const expr_t& in, const vn_expr& e, std::size_t i,
+		expr_t& out);
+};
+
+int value_numbering::key(char op, integer_t a, integer_t b)
+{
+	auto it = keys.emplace(std::make_tuple(op, a, b), nvns).first;
+	if (it->second == nvns)
+		++nvns;
+	return it->second;
+}
+
+void value_numbering::add(command& comm)
+{
+	lines.emplace_back();
+	switch (comm.type) {
+	case command::BASIC_LET:
+		add_expr(comm.expr);
+		lines.back().target = &comm.target_var;
+		lines.back().vn = exprs.back().nodes.back().vn;
+		break;
+	case command::BASIC_PRINT:
+		add_expr(comm.expr);
+		break;
+	case command::BASIC_INPUT:
+		lines.back().target = &comm.target_var;
+		lines.back().vn = nvns++;
+		break;
+	case command::BASIC_IF:
+		// in the order of linker::if_condition()
+		if (comm.cmp == "<") {
+			add_expr(comm.expr2);
+			add_expr(comm.expr);
+		} else {
+			add_expr(comm.expr);
+			add_expr(comm.expr2);
+		}
+		break;
+	default:
+		break;
+	}
+	if (lines.back().target)
+		vars[*lines.back().target] = lines.back().vn;
+}
+
+void value_numbering::add_expr(expr_t& expr)
+{
+	vn_expr e;
+	e.expr = &expr;
+	e.nodes.resize(expr.size());
+	std::vector<std::size_t> begin(expr.size());
+	for (std::size_t i = 0; i < expr.size(); ++i) {
+		auto& token = expr[i];
+		auto& n = e.nodes[i];
+		begin[i] = i;
+		n.ops = 0;
+		switch (token.type) {
+		case expr_token::IMMEDIATE:
+			n.vn = key('#', token.num, 0);
+			break;
+		case expr_token::VARIABLE: {
+			auto it = vars.find(token.str);
+			if (it == vars.end())
+				it = vars.emplace(token.str, nvns++).first;
+			n.vn = it->second;
+			break; }
+		case expr_token::OPERATOR: {
+			auto right = i - 1;
+			n.left = begin[right] - 1;
+			begin[i] = begin[n.left];
+			auto a = e.nodes[n.left].vn;
+			auto b = e.nodes[right].vn;
+			char op = token.str[0];
+			if ((op == '+' || op == '*') && a > b)
+				std::swap(a, b);
+			auto last = nvns;
+			n.vn = key(op, a, b);
+			repeated |= n.vn < last;
+			n.ops = e.nodes[n.left].ops + e.nodes[right].ops + 1;
+			break; }
+		default:
+			assert(0);
+		}
+	}
+	lines.back().exprs.push_back(exprs.size());
+	exprs.push_back(std::move(e));
+}
+
+// Walk the run in the order it runs, and choose what to do with each node.
+void value_numbering::choose_uses()
+{
+	gains.clear();
+	avail.clear();
+	holders.clear();
+	now.clear();
+	for (auto& line : lines) {
+		for (auto e : line.exprs)
+			visit(e, exprs[e].nodes.size() - 1);
+		if (line.target) {
+			now[*line.target] = line.vn;
+			holders[line.vn] = *line.target;
+		}
+	}
+}
+
+void value_numbering::visit(std::size_t e, std::size_t i)
+{
+	auto& n = exprs[e].nodes[i];
+	n.use = vn_node::KEEP;
+	n.from = NO_NODE;
+	if (n.left == NO_NODE)
+		return;
+	auto h = holders.find(n.vn);
+	if (h != holders.end() && now[h->second] == n.vn) {
+		n.use = vn_node::REUSE;
+		n.var = h->second;
+		return;
+	}
+	auto a = avail.find(n.vn);
+	if (a != avail.end() && !banned.count(n.vn)) {
+		n.use = vn_node::REUSE;
+		n.from_expr = a->second.first;
+		n.from = a->second.second;
+		gains[n.vn] += n.ops;
+		return;
+	}
+	if (a == avail.end())
+		avail.emplace(n.vn, std::make_pair(e, i));
+	visit(e, n.left);
+	visit(e, i - 1);
+}
+
+void value_numbering::rewrite(const expr_t& in, const vn_expr& e,
+	std::size_t i, expr_t& out)
+{
+	auto& n = e.nodes[i];
+	if (n.use == vn_node::REUSE) {
+		expr_token token;
+		token.type = expr_token::VARIABLE;
+		token.str = n.var;
+		out.push_back(std::move(token));
+		return;
+	}
+	if (n.left != NO_NODE) {
+		rewrite(in, e, n.left, out);
+		rewrite(in, e, i - 1, out);
+	}
+	out.push_back(in[i]);
+	if (n.use == vn_node::SAVE) {
+		expr_token token;
+		token.type = expr_token::SAVE;
+		token.str = n.var;
+		out.push_back(std::move(token));
+	}
+}
+
+void value_numbering::finish()
+{
+	if (repeated)
+		reuse();
+	exprs.clear();
+	lines.clear();
+	nvns = 0;
+	repeated = false;
+	keys.clear();
+	vars.clear();
+}
+
+// A SAVE costs about one operator, so one that only spares a single
+// operator is not worth it. Not reusing such a value may leave other values
+// to reuse, so uses are chosen again until every SAVE left is worth it.
+void value_numbering::reuse()
+{
+	banned.clear();
+	while (1) {
+		choose_uses();
+		bool again = false;
+		for (auto& g : gains)
+			if (g.second < 2 && banned.insert(g.first).second)
+				again = true;
+		if (!again)
+			break;
+	}
+	int ntemps = 0;
+	for (auto& e : exprs) {
+		for (auto& n : e.nodes) {
+			if (n.use != vn_node::REUSE || n.from == NO_NODE)
+				continue;
+			auto& from = exprs[n.from_expr].nodes[n.from];
+			if (from.use != vn_node::SAVE) {
+				from.use = vn_node::SAVE;
+				from.var = "~V" + std::to_string(ntemps++);
+			}
+			n.var = from.var;
+		}
+	}
+	for (auto& e : exprs) {
+		if (e.nodes.empty())
+			continue;
+		expr_t out;
+		rewrite(*e.expr, e, e.nodes.size() - 1, out);
+		*e.expr = std::move(out);
+	}
+}
+
+} // namespace
+
+void number_values(object_code_t& obj)
+{
+	std::unordered_set<std::size_t> targets;
+	for (auto& line : obj) {
+		auto& a = line.second;
+		if (a.type == command::BASIC_GOTO || a.type == command::BASIC_IF)
+			targets.insert(a.target_lineno);
+	}
+	value_numbering vn;
+	for (auto& line : obj) {
+		if (targets.count(line.first))
+			vn.finish();
+		vn.add(line.second);
+		if (line.second.type == command::BASIC_GOTO ||
+				line.second.type == command::BASIC_END)
+			vn.finish();
+	}
+	vn.finish();
+}
+
+} // namespace BASIC
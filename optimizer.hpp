@@ -0,0 +1,99 @@
+#ifndef BASIC_OPTIMIZER_HPP
+#define BASIC_OPTIMIZER_HPP
+
+#include "common.hpp"
+
+#include "command.hpp"
+
+namespace BASIC {
+
+// Passes over object code, which the linker runs before emitting code when
+// optimization is on. A program optimized prints the same and stops with the
+// same error at the same line as it would as written.
+
+// How close_loops() counts the iterations of a loop that it runs in closed
+// form. After its first iteration, the loop tests the difference in the
+// variable diff, which each later one adds step, 1 or -1, to. It goes on
+// while that is zero, for ZERO, or positive, for POSITIVE, or while it is
+// not, if negated. The iterations after the first go to count, and
+// count * (count + 1) / 2 to triangle, as unsigned numbers that wrap around.
+struct loop_count {
+	enum {
+		ZERO,
+		POSITIVE,
+	} test;
+	bool negated;
+	integer_t step;
+	std::string diff;
+	std::string count;
+	std::string triangle;
+};
+
+// What the passes from invert_loops() on add to a line, beyond the command
+// the compiler made of it:
+struct line_notes {
+	// an IF that jumps if its comparison is false, see invert_loops(),
+	bool negated = false;
+	// a GOTO or IF that lands after the hoisted LETs of its target,
+	bool past_hoisted = false;
+	// LETs of hidden variables, which run before the line, see
+	// hoist_invariants(),
+	std::vector<command> hoisted;
+	// and a loop count, which is computed after them, see close_loops().
+	std_optional<loop_count> count;
+};
+
+// Notes by line number. Lines without any have none.
+using line_notes_t = std::map<std::size_t, line_notes>;
+
+// Fold operators of constants, drop operations by identities such as X * 1
+// and X + 0, and merge the constants of chains such as X + 1 - 3. Every
+// variable is still read, and every division that may trap still runs.
+void fold_constants(expr_t& expr);
+void fold_constants(object_code_t& obj);
+
+// Make GOTO and IF jump straight to where chains of GOTO lead, and decide
+// IFs of two constants. Jumps to missing lines are kept as they are, so that
+// they still trap.
+void thread_jumps(object_code_t& obj);
+
+// Drop the lines that no path from the first line reaches, and then GOTOs to
+// the line that runs next anyway. END falls through to the next line, where
+// CONT goes on.
+void drop_unreachable(object_code_t& obj);
+
+// Drop LETs to variables that are not live after them, if they cannot trap.
+// A variable is live where it may be read before it is assigned again, and
+// those that are not hidden are also live wherever the program may stop.
+void eliminate_dead_stores(object_code_t& obj);
+
+// Turn loops of the shape
+//	T: IF c THEN X; ...; B: GOTO T
+// where X is where B would fall through to, around, so that B becomes an IF
+// that jumps back to the line after T unless c. Then an iteration takes one
+// jump instead of two, and T only tests whether the loop is entered.
+void invert_loops(object_code_t& obj, line_notes_t& notes);
+
+// Compute subexpressions that do not change in a loop once, in LETs of
+// hidden variables named ~L<n> hoisted to its head, which jumps back from
+// the loop skip. Only those that cannot trap are, so the same errors
+// happen.
+void hoist_invariants(object_code_t& obj, line_notes_t& notes);
+
+// Run loops of LETs that count a variable up or down by 1 until an IF at
+// their bottom sees it pass a bound that does not change, in closed form.
+// The head computes how many iterations the loop would run, and the lines
+// after it set the variables that the loop assigns to what it would leave
+// them: sums over the count, or the values of the last iteration. Results
+// wrap around as the loop's would, even after 2^64 iterations.
+void close_loops(object_code_t& obj, line_notes_t& notes);
+
+// Compute subexpressions that a straight run of lines evaluates more than
+// once only the first time. Later ones read a variable that still holds the
+// value, or a hidden one that a SAVE token stores it in, named ~V<n>. A run
+// starts at a line some GOTO or IF may jump to, or after GOTO or END.
+void number_values(object_code_t& obj);
+
+} // namespace BASIC
+
+#endif // BASIC_OPTIMIZER_HPP
@@ -0,0 +1,121 @@
+#include "perf.hpp"
+
+#ifdef BASIC_HAVE_PERF
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace BASIC {
+
+#ifdef BASIC_HAVE_PERF
+namespace {
+
+int open_counter(perf_counters::counter_type counter)
+{
+	perf_event_attr attr;
+	std::memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	switch (counter) {
+	case perf_counters::CYCLES:
+		attr.config = PERF_COUNT_HW_CPU_CYCLES;
+		break;
+	case perf_counters::INSTRUCTIONS:
+		attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+		break;
+	case perf_counters::BRANCH_MISSES:
+		attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+		break;
+	case perf_counters::L1D_MISSES:
+		attr.type = PERF_TYPE_HW_CACHE;
+		attr.config = PERF_COUNT_HW_CACHE_L1D |
+			PERF_COUNT_HW_CACHE_OP_READ << 8 |
+			PERF_COUNT_HW_CACHE_RESULT_MISS << 16;
+		break;
+	default:
+		assert(0);
+	}
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+} // namespace
+#endif // BASIC_HAVE_PERF
+
+perf_counters::perf_counters()
+{
+	for (int i = 0; i < NCOUNTERS; ++i) {
+#ifdef BASIC_HAVE_PERF
+		fds[i] = open_counter(static_cast<counter_type>(i));
+#else
+		fds[i] = -1;
+#endif
+	}
+}
+
+perf_counters::~perf_counters()
+{
+#ifdef BASIC_HAVE_PERF
+	for (auto fd : fds)
+		if (fd >= 0)
+			close(fd);
+#endif
+}
+
+bool perf_counters::available() const
+{
+	return std::any_of(std::begin(fds), std::end(fds), [](int fd) {
+		return fd >= 0;
+	});
+}
+
+void perf_counters::start()
+{
+#ifdef BASIC_HAVE_PERF
+	for (auto fd : fds) {
+		if (fd < 0)
+			continue;
+		ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+		ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+	}
+#endif
+}
+
+perf_counters::values_t perf_counters::stop()
+{
+	values_t values;
+#ifdef BASIC_HAVE_PERF
+	for (auto fd : fds)
+		if (fd >= 0)
+			ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+	for (int i = 0; i < NCOUNTERS; ++i) {
+		std::uint64_t n;
+		if (fds[i] >= 0 && read(fds[i], &n, sizeof(n)) == sizeof(n))
+			values[i] = n;
+	}
+#endif
+	return values;
+}
+
+const char* perf_counters::name(counter_type counter)
+{
+	switch (counter) {
+	case CYCLES:
+		return "CYCLES";
+	case INSTRUCTIONS:
+		return "INSTRUCTIONS";
+	case BRANCH_MISSES:
+		return "BRANCH MISSES";
+	case L1D_MISSES:
+		return "L1D MISSES";
+	default:
+		assert(0);
+	}
+	return "";
+}
+
+} // namespace BASIC
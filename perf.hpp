@@ -0,0 +1,41 @@
+#ifndef BASIC_PERF_HPP
+#define BASIC_PERF_HPP
+
+#include "common.hpp"
+
+namespace BASIC {
+
+// Hardware counters of the calling thread in user mode. Each is opened on
+// its own, so that a CPU or a VM without one of them still has the others,
+// and none are available without BASIC_HAVE_PERF or where perf events are
+// not allowed.
+class perf_counters {
+public:
+	enum counter_type {
+		CYCLES,
+		INSTRUCTIONS,
+		BRANCH_MISSES,
+		L1D_MISSES,
+		NCOUNTERS,
+	};
+	using values_t = std::array<std_optional<std::uint64_t>, NCOUNTERS>;
+
+	perf_counters();
+	~perf_counters();
+	perf_counters(const perf_counters&) = delete;
+	perf_counters& operator=(const perf_counters&) = delete;
+
+	bool available() const;
+	// Reset and start the counters.
+	void start();
+	// Stop them, and return their values since start().
+	values_t stop();
+	static const char* name(counter_type counter);
+
+private:
+	int fds[NCOUNTERS];
+};
+
+} // namespace BASIC
+
+#endif // BASIC_PERF_HPP
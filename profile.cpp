@@ -0,0 +1,56 @@
+#include "machine.hpp"
+
+// The profiler of machine: step() over binary code, as in the switch engine,
+// charging each instruction to its BASIC line from program::lines. The clock
+// is read when control goes from one line to another, so that time costs
+// little more than a loop that stays in one line.
+
+namespace BASIC {
+
+void machine::run_profiled(const program& prog)
+{
+	auto& code = prog.code;
+	auto& p = _profile;
+	if (p.id != prog.id) {
+		p = profile_t();
+		p.id = prog.id;
+		p.index.resize(code.size());
+		for (std::size_t i = 0; i < code.size(); ++i) {
+			if (i == 0 || prog.lines[i] != prog.lines[i - 1])
+				p.lines.push_back({prog.lines[i], 0, 0, {}});
+			p.index[i] = p.lines.size() - 1;
+		}
+	}
+
+	using clock = std::chrono::steady_clock;
+	constexpr std::size_t NONE = -1;
+	std::size_t line = NONE;
+	auto since = clock::now();
+	// charge the time since the last change of line to the current one
+	auto charge = [&](std::size_t next) {
+		auto now = clock::now();
+		if (line != NONE)
+			p.lines[line].time += now - since;
+		since = now;
+		line = next;
+	};
+	try {
+		while (!reg.STOP && static_cast<size_t>(reg.PC) < code.size()) {
+			std::size_t pc = reg.PC;
+			auto l = p.index[pc];
+			if (l != line)
+				charge(l);
+			auto& lp = p.lines[l];
+			if (pc == 0 || p.index[pc - 1] != l)
+				++lp.count;
+			++lp.steps;
+			step(code[pc]);
+		}
+	} catch (...) {
+		charge(NONE);
+		throw;
+	}
+	charge(NONE);
+}
+
+} // namespace BASIC
@@ -0,0 +1,148 @@
+#ifndef BASIC_PROGRAM_HPP
+#define BASIC_PROGRAM_HPP
+
+#include "common.hpp"
+
+#include "instruction.hpp"
+
+namespace BASIC {
+
+// An instruction pre-decoded for the direct-threaded engine.
+struct threaded_instruction {
+	// address of the handler of (opcode, mode), and for three-address
+	// form, of whether each source is a variable too
+	const void* handler;
+	integer_t operand[instruction::NOPERANDS];
+};
+
+using threaded_code_t = std::vector<threaded_instruction>;
+
+// An instruction of compact code, or the extension word after one in
+// three-address form, which holds its operand[1] and operand[2].
+union compact_instruction {
+	struct {
+		// index into the handler table of the threaded engine
+		std::uint16_t handler;
+		// op_hi of the instruction. Bit (12 + n) tells that operand n
+		// is an index into the constant pool.
+		std::uint16_t op_hi;
+		std::int32_t operand;
+	};
+	std::int32_t ext[2];
+};
+
+static_assert(sizeof(compact_instruction) == 8,
+	"compact instructions are 8 bytes");
+
+struct compact_code_t {
+	std::vector<compact_instruction> code;
+	// immediates that do not fit in 32 bits
+	std::vector<integer_t> pool;
+	// offset in code of each instruction, and of the end
+	std::vector<std::uint32_t> offsets;
+};
+
+#ifdef BASIC_HAVE_JIT
+// Executable memory holding the native code of a program. See jit.cpp.
+class native_code_t {
+	void* _addr = nullptr;
+	std::size_t _size = 0;
+	// offsets of the instructions where a machine may resume
+	std::unordered_map<integer_t, std::size_t> _entries;
+public:
+	native_code_t() = default;
+	native_code_t(void* addr, std::size_t size,
+			std::unordered_map<integer_t, std::size_t> entries):
+		_addr(addr),
+		_size(size),
+		_entries(std::move(entries))
+	{ }
+	native_code_t(native_code_t&& other) noexcept
+	{
+		*this = std::move(other);
+	}
+	native_code_t& operator=(native_code_t&& other) noexcept
+	{
+		std::swap(_addr, other._addr);
+		std::swap(_size, other._size);
+		std::swap(_entries, other._entries);
+		return *this;
+	}
+	~native_code_t();
+	bool empty() const
+	{
+		return !_addr;
+	}
+	const void* get() const
+	{
+		return _addr;
+	}
+	const void* entry(integer_t pc) const
+	{
+		return static_cast<const char*>(_addr) + _entries.at(pc);
+	}
+};
+#endif
+
+class machine;
+
+// Closure-compiled code: a callable for each statement, which runs it on a
+// machine and returns the index of the next one, or CLOSURE_HALT.
+using closure_t = std::function<std::size_t(machine&)>;
+constexpr std::size_t CLOSURE_HALT = -1;
+
+struct closure_code_t {
+	// It ends with a statement that halts.
+	std::vector<closure_t> code;
+	// index in binary code where each statement starts
+	std::vector<integer_t> start;
+};
+
+// A hot loop recorded as a linear path, as closure code without the final
+// HALT. Index code.size() goes back to the start of the loop, and index
+// code.size() + 1 + k leaves it for instruction exits[k].
+struct superblock_t {
+	closure_code_t code;
+	std::vector<integer_t> exits;
+};
+
+// What the trace engine of a machine learns about a program while running
+// it.
+struct trace_cache_t {
+	// id of the program
+	std::uint64_t id = 0;
+	// times backward jumps to each instruction were taken
+	std::vector<std::uint32_t> hits;
+	// superblocks by the instruction they start at
+	std::unordered_map<integer_t, superblock_t> blocks;
+};
+
+// A linked program, with the forms prepared for the execution engines. Once
+// prepared, it is not changed by running it, so machines in many threads
+// can run one program at once.
+struct program {
+	binary_code_t code;
+	// BASIC line number of each instruction
+	std::vector<std::size_t> lines;
+	// maximum depth of the operand stack, computed by the linker
+	std::size_t max_stack = 0;
+	// variable slots of the symbol table it was linked with
+	std::size_t nvars = 0;
+	// unique to each program linked
+	std::uint64_t id = 0;
+	// Filled by machine::prepare() if the direct-threaded engine is used.
+	// It ends with an extra HALT so that running off the end stops.
+	threaded_code_t threaded;
+	// The same for the compact engine.
+	compact_code_t compact;
+	// The same for the closure engine.
+	closure_code_t closure;
+#ifdef BASIC_HAVE_JIT
+	// The same for the JIT engine.
+	native_code_t native;
+#endif
+};
+
+} // namespace BASIC
+
+#endif // BASIC_PROGRAM_HPP
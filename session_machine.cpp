@@ -0,0 +1,34 @@
+#include "session_machine.hpp"
+
+#include "error.hpp"
+
+namespace BASIC {
+
+machine::run_status session_machine::feed(const program& prog, integer_t num)
+{
+	_input = num;
+	return resume(prog);
+}
+
+std::string session_machine::take_output()
+{
+	auto s = _output.str();
+	_output.str("");
+	return s;
+}
+
+integer_t session_machine::input_number()
+{
+	if (!_input)
+		throw input_wanted();
+	integer_t num = *_input;
+	_input = std_nullopt;
+	return num;
+}
+
+void session_machine::print_number(integer_t num)
+{
+	_output << num << '\n';
+}
+
+} // namespace BASIC
@@ -0,0 +1,32 @@
+#ifndef BASIC_SESSION_MACHINE_HPP
+#define BASIC_SESSION_MACHINE_HPP
+
+#include "common.hpp"
+
+#include "machine.hpp"
+
+namespace BASIC {
+
+// input: the number given by feed(), or wait for one
+// print: into a buffer, taken by take_output()
+//
+// It never blocks, so one thread can serve many of them, feeding each the
+// input of its user as it comes.
+struct session_machine : machine {
+	// Give the INPUT that the program waits at a number, and go on.
+	run_status feed(const program& prog, integer_t num);
+	// the output since the last call
+	std::string take_output();
+
+	virtual integer_t input_number() override;
+	virtual void print_number(integer_t) override;
+	virtual ~session_machine() override = default;
+
+private:
+	std_optional<integer_t> _input;
+	std::ostringstream _output;
+};
+
+} // namespace BASIC
+
+#endif // BASIC_SESSION_MACHINE_HPP
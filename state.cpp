@@ -0,0 +1,131 @@
+#include "machine.hpp"
+
+#include "error.hpp"
+
+// Snapshots of machine: the registers, the variables and the operand stack
+// as a header and raw arrays, which load_state() reads straight back into
+// place. They are only meant for the same build on the same machine.
+
+namespace BASIC {
+
+namespace {
+
+const char STATE_MAGIC[8] = {'B', 'A', 'S', 'I', 'C', 'V', 'M', 1};
+
+struct state_header {
+	char magic[8];
+	// of the binary code of the program, see fingerprint()
+	std::uint64_t fingerprint;
+	std::uint64_t nvars;
+	std::uint64_t nstack;
+	integer_t PC;
+	integer_t STEP;
+	integer_t SP;
+};
+
+// FNV-1a over what a program does, so that a state is not loaded into
+// another program. Unused operands are left out, as they are not set.
+std::uint64_t fingerprint(const binary_code_t& code)
+{
+	std::uint64_t h = 14695981039346656037ull;
+	auto mix = [&h](integer_t n) {
+		for (int i = 0; i < 8; ++i) {
+			h ^= static_cast<std::uint64_t>(n) >> (8 * i) & 0xff;
+			h *= 1099511628211ull;
+		}
+	};
+	for (auto& ins : code) {
+		mix(ins.op_lo);
+		if ((ins.op_lo & 0x0f) == 4) {
+			mix(ins.op_hi);
+			for (int i = 0; i < instruction::NOPERANDS; ++i)
+				if (operand_mode(ins, i))
+					mix(ins.operand[i]);
+		} else if (ins.op_lo & 0x0f) {
+			mix(ins.operand[0]);
+		}
+	}
+	return h;
+}
+
+template<class T>
+void write_array(std::ostream& os, const std::vector<T>& v, std::size_t n)
+{
+	os.write(reinterpret_cast<const char*>(v.data()), n * sizeof(T));
+}
+
+template<class T>
+void read_array(std::istream& is, std::vector<T>& v, std::size_t n)
+{
+	v.resize(n);
+	if (!is.read(reinterpret_cast<char*>(v.data()), n * sizeof(T)))
+		throw error::file_error();
+}
+
+} // namespace
+
+// Only the stack up to reg.SP is live.
+void machine::save_state(std::ostream& os, const program& prog) const
+{
+	state_header h;
+	std::memcpy(h.magic, STATE_MAGIC, sizeof(h.magic));
+	h.fingerprint = fingerprint(prog.code);
+	h.nvars = vars.size();
+	h.nstack = reg.SP + 1;
+	h.PC = reg.PC;
+	h.STEP = reg.STEP;
+	h.SP = reg.SP;
+	os.write(reinterpret_cast<const char*>(&h), sizeof(h));
+	write_array(os, vars.value, vars.size());
+	write_array(os, vars.defined, vars.defined.size());
+	write_array(os, stack, h.nstack);
+	if (!os)
+		throw error::file_error();
+}
+
+// The state is read aside first, so that a bad one leaves the machine
+// as it was. Its sizes are checked against the program and what is left of
+// the file before anything is allocated for them. States are saved where
+// END stopped, so PC must be right after a HALT or at the end, where every
+// engine can go on; JIT code has no entry anywhere else.
+void machine::load_state(std::istream& is, const program& prog)
+{
+	state_header h;
+	if (!is.read(reinterpret_cast<char*>(&h), sizeof(h)) ||
+			std::memcmp(h.magic, STATE_MAGIC, sizeof(h.magic)) != 0 ||
+			h.nvars != prog.nvars || h.SP < 0 ||
+			h.nstack != static_cast<std::uint64_t>(h.SP) + 1 ||
+			h.nstack > prog.max_stack + 1 || h.PC < 0 ||
+			static_cast<std::size_t>(h.PC) > prog.code.size())
+		throw error::file_error();
+	if (static_cast<std::size_t>(h.PC) != prog.code.size() && (h.PC == 0 ||
+			(prog.code[h.PC - 1].op_lo >> 4) != instruction::OP_HALT))
+		throw error::file_error();
+	if (h.fingerprint != fingerprint(prog.code))
+		throw error::state_mismatch();
+	auto pos = is.tellg();
+	if (pos != std::istream::pos_type(-1)) {
+		is.seekg(0, std::ios::end);
+		auto left = static_cast<std::uint64_t>(is.tellg() - pos);
+		is.seekg(pos);
+		if (left < (h.nvars + h.nstack) * sizeof(integer_t) +
+				(h.nvars + 63) / 64 * sizeof(std::uint64_t))
+			throw error::file_error();
+	}
+	var_pool_t v;
+	read_array(is, v.value, h.nvars);
+	read_array(is, v.defined, (h.nvars + 63) / 64);
+	stack_t s;
+	read_array(is, s, h.nstack);
+	s.resize(prog.max_stack + 1);
+
+	vars = std::move(v);
+	stack = std::move(s);
+	reg.PC = h.PC;
+	reg.STEP = h.STEP;
+	reg.STOP = 0;
+	reg.SP = h.SP;
+	traces = trace_cache_t();
+}
+
+} // namespace BASIC
@@ -0,0 +1,41 @@
+#ifndef BASIC_SYMBOL_TABLE_HPP
+#define BASIC_SYMBOL_TABLE_HPP
+
+#include "common.hpp"
+
+namespace BASIC {
+
+// Slots of variables by name. The linker adds to it, and machines only see
+// slots, so one table serves every machine running programs linked with it.
+class symbol_table {
+public:
+	// Slot of a variable, which is added if it is new.
+	integer_t get(const std::string& name)
+	{
+		auto result = static_cast<integer_t>(map.size());
+		return map.emplace(name, result).first->second;
+	}
+	std::size_t size() const
+	{
+		return map.size();
+	}
+	// names of the slots in order, which get() adds back as they were
+	std::vector<std::string> names() const
+	{
+		std::vector<std::string> result(map.size());
+		for (auto& p : map)
+			result[p.second] = p.first;
+		return result;
+	}
+	void clear()
+	{
+		map.clear();
+	}
+
+private:
+	std::unordered_map<std::string, integer_t> map;
+};
+
+} // namespace BASIC
+
+#endif // BASIC_SYMBOL_TABLE_HPP
@@ -0,0 +1,64 @@
+#!/bin/bash
+# Feed sessions to the console and compare what it prints with what is
+# expected. Each test is a function that calls expect with its name, the
+# lines typed and the output wanted. Print the name of each test that
+# fails, and exit with the number of them.
+#
+# usage: tests/console.sh
+# The binary must be built with -DNOT_LAB2_JUDGE, as `make check` does.
+
+BIN=${BIN:-./basic-lab2}
+
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+failed=0
+
+# expect NAME INPUT OUTPUT
+expect() {
+	local got
+	got=$(printf '%s\n' "$2" | "$BIN" 2>&1)
+	if [ "$got" != "$3" ]; then
+		echo "FAIL $1"
+		diff <(printf '%s\n' "$3") <(printf '%s\n' "$got") | sed 's/^/\t/'
+		failed=$((failed + 1))
+	fi
+}
+
+PROG='10 LET A = 5
+20 END
+30 PRINT A'
+
+# A state whose header claims more variables than the program has is
+# refused before anything is allocated for them.
+test_state_inflated_nvars() {
+	expect "state saved" "$PROG
+RUN
+SAVESTATE $tmp/ok.state" ""
+	# nvars follows the names line, the magic and the fingerprint
+	local off=$(( $(head -n 1 "$tmp/ok.state" | wc -c) + 16 ))
+	cp "$tmp/ok.state" "$tmp/big.state"
+	printf '\0\0\0\0\0\0\0\040' |
+		dd of="$tmp/big.state" bs=1 seek=$off conv=notrunc 2>/dev/null
+	expect "state inflated nvars" "$PROG
+LOADSTATE $tmp/big.state
+LOADSTATE $tmp/ok.state
+CONT" "FILE ERROR
+5"
+}
+
+# Statements typed after END run aside, so CONT still goes on there, and
+# sees what LET assigned.
+test_cont_after_print() {
+	expect "cont after print" "10 LET A = 5
+20 END
+30 PRINT A * 2
+RUN
+PRINT A
+LET A = 7
+CONT" "5
+14"
+}
+
+test_state_inflated_nvars
+test_cont_after_print
+exit $failed
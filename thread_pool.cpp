@@ -0,0 +1,110 @@
+#include "thread_pool.hpp"
+
+namespace BASIC {
+
+namespace {
+
+// index of the current thread in its pool
+thread_local const void* current_pool = nullptr;
+thread_local std::size_t current_id;
+
+} // namespace
+
+thread_pool::thread_pool(std::size_t nthreads)
+{
+	if (nthreads == 0)
+		nthreads = std::max(1u, std::thread::hardware_concurrency());
+	for (std::size_t i = 0; i < nthreads; ++i)
+		queues.emplace_back(new task_queue);
+	for (std::size_t i = 0; i < nthreads; ++i)
+		threads.emplace_back(&thread_pool::work, this, i);
+}
+
+thread_pool::~thread_pool()
+{
+	{
+		std::lock_guard<std::mutex> l(lock);
+		stopping = true;
+	}
+	has_work.notify_all();
+	for (auto& t : threads)
+		t.join();
+}
+
+// A thread about to sleep counts itself in sleeping before it looks at
+// queued, and this counts the task in queued before it looks at sleeping,
+// so one of them sees the other. The sleeper holds the lock until it waits,
+// so taking it here makes the notification come after.
+void thread_pool::submit(task_t task)
+{
+	std::size_t id;
+	if (current_pool == this)
+		id = current_id;
+	else
+		id = next_queue++ % queues.size();
+	++pending;
+	{
+		std::lock_guard<std::mutex> q(queues[id]->lock);
+		queues[id]->tasks.push_back(std::move(task));
+	}
+	++queued;
+	if (sleeping > 0) {
+		std::lock_guard<std::mutex> l(lock);
+		has_work.notify_one();
+	}
+}
+
+void thread_pool::wait()
+{
+	std::unique_lock<std::mutex> l(lock);
+	all_done.wait(l, [this]() {
+		return pending == 0;
+	});
+}
+
+bool thread_pool::take(std::size_t id, task_t& task)
+{
+	for (std::size_t i = 0; i < queues.size(); ++i) {
+		auto& q = *queues[(id + i) % queues.size()];
+		std::lock_guard<std::mutex> l(q.lock);
+		if (q.tasks.empty())
+			continue;
+		if (i == 0) {
+			task = std::move(q.tasks.back());
+			q.tasks.pop_back();
+		} else {
+			task = std::move(q.tasks.front());
+			q.tasks.pop_front();
+		}
+		return true;
+	}
+	return false;
+}
+
+void thread_pool::work(std::size_t id)
+{
+	current_pool = this;
+	current_id = id;
+	while (1) {
+		task_t task;
+		if (take(id, task)) {
+			--queued;
+			task();
+			if (--pending == 0) {
+				std::lock_guard<std::mutex> l(lock);
+				all_done.notify_all();
+			}
+			continue;
+		}
+		std::unique_lock<std::mutex> l(lock);
+		++sleeping;
+		has_work.wait(l, [this]() {
+			return stopping || queued > 0;
+		});
+		--sleeping;
+		if (stopping && queued == 0)
+			return;
+	}
+}
+
+} // namespace BASIC
@@ -0,0 +1,58 @@
+#ifndef BASIC_THREAD_POOL_HPP
+#define BASIC_THREAD_POOL_HPP
+
+#include "common.hpp"
+
+namespace BASIC {
+
+// A pool of threads running tasks. Each thread has a deque of tasks under a
+// lock of its own, takes the newest of its own, and steals the oldest of
+// another thread if it has none left. The lock of the pool is only taken to
+// sleep when there is nothing to take, and to wake threads that do. Tasks
+// must not throw.
+class thread_pool {
+public:
+	using task_t = std::function<void()>;
+
+	// all cores by default
+	explicit thread_pool(std::size_t nthreads = 0);
+	~thread_pool();
+	thread_pool(const thread_pool&) = delete;
+	thread_pool& operator=(const thread_pool&) = delete;
+
+	std::size_t size() const
+	{
+		return threads.size();
+	}
+	// Add a task to the deque of the calling thread if it is one of the
+	// pool, or to that of each thread in turn.
+	void submit(task_t task);
+	// Wait until all tasks submitted are done.
+	void wait();
+
+private:
+	struct task_queue {
+		std::mutex lock;
+		std::deque<task_t> tasks;
+	};
+	std::vector<std::unique_ptr<task_queue>> queues;
+	std::vector<std::thread> threads;
+	// for the condition variables and stopping
+	std::mutex lock;
+	std::condition_variable has_work;
+	std::condition_variable all_done;
+	bool stopping = false;
+	// tasks submitted and not taken yet, and not done yet
+	std::atomic<std::size_t> queued{0};
+	std::atomic<std::size_t> pending{0};
+	// threads waiting for has_work
+	std::atomic<std::size_t> sleeping{0};
+	std::atomic<std::size_t> next_queue{0};
+
+	void work(std::size_t id);
+	bool take(std::size_t id, task_t& task);
+};
+
+} // namespace BASIC
+
+#endif // BASIC_THREAD_POOL_HPP
@@ -0,0 +1,499 @@
+#include "machine.hpp"
+
+#include "error.hpp"
+
+// The threaded engines of machine: direct-threaded code, and compact code
+// dispatched through the handler table. Both share the handlers below.
+
+#ifdef BASIC_HAVE_COMPUTED_GOTO
+
+namespace BASIC {
+
+namespace {
+
+// Layout of the handler table of machine::run_threaded(). Handlers of the
+// stack form are indexed by op_lo. Those of the three-address form follow,
+// four per opcode, by whether the first and the second source are variables.
+// The last ones are only used by compact code with pooled immediates.
+constexpr std::size_t HANDLERS_REGISTER = INSTRUCTION_NOPS << 4;
+constexpr std::size_t HANDLER_PUSH_POOL =
+	HANDLERS_REGISTER + INSTRUCTION_NOPS * 4;
+constexpr std::size_t HANDLERS_POOL = HANDLER_PUSH_POOL + 1;
+constexpr std::size_t NHANDLERS = HANDLERS_POOL + INSTRUCTION_NOPS;
+
+std::size_t handler_index(const instruction& ins)
+{
+	if ((ins.op_lo & 0x0f) != 4)
+		return ins.op_lo;
+	auto op = ins.op_lo >> 4;
+	std::size_t vars;
+	switch (op) {
+	case instruction::OP_PRINT:
+		vars = operand_mode(ins, 0) == 2;
+		break;
+	case instruction::OP_MOV:
+		vars = operand_mode(ins, 1) == 2;
+		break;
+	default:
+		vars = (operand_mode(ins, 1) == 2) |
+			(operand_mode(ins, 2) == 2) << 1;
+		break;
+	}
+	return HANDLERS_REGISTER + op * 4 + vars;
+}
+
+// Direct-threaded code: one word per instruction, holding the handler
+// address itself. Jump operands are instruction indices.
+struct direct_layout {
+	using code_t = threaded_code_t;
+	using word_t = threaded_instruction;
+	// words of an instruction in three-address form
+	static constexpr int LEN3 = 1;
+
+	static const word_t* begin(const code_t& code)
+	{
+		return code.data();
+	}
+	static const word_t* at(const code_t& code, integer_t pc)
+	{
+		return code.data() + pc;
+	}
+	static integer_t pc(const code_t& code, const word_t* ip)
+	{
+		return ip - code.data();
+	}
+	static const void* handler(const word_t* ip, const void* const*)
+	{
+		return ip->handler;
+	}
+	static integer_t arg(const word_t* ip, int i)
+	{
+		return ip->operand[i];
+	}
+	static integer_t pooled(const code_t&, integer_t)
+	{
+		assert(0);
+		return 0;
+	}
+	static instruction decode(const code_t&, const word_t*)
+	{
+		assert(0);
+		return instruction();
+	}
+};
+
+// Compact code: 8 bytes per instruction, plus an extension word holding
+// operand[1] and operand[2] for three-address form. Jump operands are word
+// offsets.
+struct compact_layout {
+	using code_t = compact_code_t;
+	using word_t = compact_instruction;
+	static constexpr int LEN3 = 2;
+
+	static const word_t* begin(const code_t& code)
+	{
+		return code.code.data();
+	}
+	static const word_t* at(const code_t& code, integer_t pc)
+	{
+		return code.code.data() + code.offsets[pc];
+	}
+	static integer_t pc(const code_t& code, const word_t* ip)
+	{
+		auto& o = code.offsets;
+		std::uint32_t off = ip - code.code.data();
+		return std::upper_bound(o.begin(), o.end(), off) - o.begin() - 1;
+	}
+	static const void* handler(const word_t* ip,
+			const void* const* handlers)
+	{
+		return handlers[ip->handler];
+	}
+	static integer_t arg(const word_t* ip, int i)
+	{
+		return i == 0 ? ip->operand : ip[1].ext[i - 1];
+	}
+	static integer_t pooled(const code_t& code, integer_t i)
+	{
+		return code.pool[i];
+	}
+	// Back to the instruction of the handlers in HANDLERS_POOL.
+	static instruction decode(const code_t& code, const word_t* ip)
+	{
+		instruction ins;
+		std::memset(&ins, 0, sizeof(ins));
+		ins.op_lo = (ip->handler - HANDLERS_POOL) << 4 | 4;
+		ins.op_hi = ip->op_hi & 0x0fff;
+		for (int i = 0; i < instruction::NOPERANDS; ++i) {
+			integer_t n = arg(ip, i);
+			if (ip->op_hi & (0x1000 << i))
+				n = code.pool[n];
+			else if (operand_mode(ins, i) == 8)
+				n = pc(code, code.code.data() + n);
+			ins.operand[i] = n;
+		}
+		return ins;
+	}
+};
+
+} // namespace
+
+void machine::prepare_threaded(program& prog)
+{
+	auto handlers = run_threaded<direct_layout>(nullptr);
+	auto& code = prog.threaded;
+	code.reserve(prog.code.size() + 1);
+	for (auto& ins : prog.code) {
+		threaded_instruction t;
+		t.handler = handlers[handler_index(ins)];
+		std::memcpy(t.operand, ins.operand, sizeof(t.operand));
+		code.push_back(t);
+	}
+	code.push_back({handlers[instruction::OP_HALT << 4], {-1}});
+}
+
+// Immediates that do not fit in 32 bits go to the constant pool, and bit
+// (12 + i) of op_hi tells that operand[i] is an index into it. Slots and jump
+// targets always fit.
+void machine::prepare_compact(program& prog)
+{
+	static_assert(NHANDLERS <= UINT16_MAX, "handler index is 16 bits");
+	run_threaded<compact_layout>(nullptr);
+	auto& c = prog.compact;
+	c.offsets.reserve(prog.code.size() + 1);
+	std::uint32_t off = 0;
+	for (auto& ins : prog.code) {
+		c.offsets.push_back(off);
+		off += (ins.op_lo & 0x0f) == 4 ? 2 : 1;
+	}
+	c.offsets.push_back(off);
+	c.code.reserve(off + 1);
+
+	for (auto& ins : prog.code) {
+		bool three = (ins.op_lo & 0x0f) == 4;
+		compact_instruction w, ext;
+		std::memset(&w, 0, sizeof(w));
+		std::memset(&ext, 0, sizeof(ext));
+		auto handler = handler_index(ins);
+		w.op_hi = ins.op_hi;
+		for (int i = 0; i < (three ? instruction::NOPERANDS : 1); ++i) {
+			auto mode = three ? operand_mode(ins, i) : ins.op_lo & 0x0f;
+			integer_t n = ins.operand[i];
+			if (mode == 8) {
+				n = c.offsets[n];
+			} else if (mode == 1 && (n < INT32_MIN || n > INT32_MAX)) {
+				w.op_hi |= 0x1000 << i;
+				n = c.pool.size();
+				c.pool.push_back(ins.operand[i]);
+				handler = three ? HANDLERS_POOL + (ins.op_lo >> 4) :
+					HANDLER_PUSH_POOL;
+			}
+			assert(n >= INT32_MIN && n <= INT32_MAX);
+			if (i == 0)
+				w.operand = n;
+			else
+				ext.ext[i - 1] = n;
+		}
+		w.handler = handler;
+		c.code.push_back(w);
+		if (three)
+			c.code.push_back(ext);
+	}
+
+	compact_instruction end;
+	std::memset(&end, 0, sizeof(end));
+	end.handler = instruction::OP_HALT << 4;
+	end.operand = -1;
+	c.code.push_back(end);
+}
+
+// The same instruction set as step(), but every (opcode, mode) pair has its
+// own handler, and each handler jumps to the next one directly.
+template<class Layout>
+const void* const* machine::run_threaded(const typename Layout::code_t* code)
+{
+	static const void* handlers[NHANDLERS];
+	if (!code) {
+		for (auto& h : handlers)
+			h = &&do_illegal;
+		handlers[instruction::OP_NOP << 4 | 0] = &&do_nop;
+		handlers[instruction::OP_INT << 4 | 1] = &&do_int;
+		handlers[instruction::OP_HALT << 4 | 0] = &&do_halt;
+		handlers[instruction::OP_PRINT << 4 | 0] = &&do_print;
+		handlers[instruction::OP_INPUT << 4 | 0] = &&do_input;
+		handlers[instruction::OP_PUSH << 4 | 1] = &&do_push_imm;
+		handlers[instruction::OP_PUSH << 4 | 2] = &&do_push_var;
+		handlers[instruction::OP_POP << 4 | 2] = &&do_pop_var;
+		handlers[instruction::OP_STORE << 4 | 2] = &&do_store_var;
+		handlers[instruction::OP_ADD << 4 | 0] = &&do_add;
+		handlers[instruction::OP_SUB << 4 | 0] = &&do_sub;
+		handlers[instruction::OP_MUL << 4 | 0] = &&do_mul;
+		handlers[instruction::OP_DIV << 4 | 0] = &&do_div;
+		handlers[instruction::OP_JMP << 4 | 8] = &&do_jmp;
+		handlers[instruction::OP_JZ << 4 | 8] = &&do_jz;
+		handlers[instruction::OP_JP << 4 | 8] = &&do_jp;
+		handlers[instruction::OP_JNZ << 4 | 8] = &&do_jnz;
+		handlers[instruction::OP_JNP << 4 | 8] = &&do_jnp;
+#define SET_HANDLER3(op, name, n) \
+		handlers[HANDLERS_REGISTER + instruction::op * 4 + n] = \
+			&&name##_##n
+#define SET_HANDLERS3(op, name) \
+		SET_HANDLER3(op, name, 0); \
+		SET_HANDLER3(op, name, 1); \
+		SET_HANDLER3(op, name, 2); \
+		SET_HANDLER3(op, name, 3)
+		SET_HANDLERS3(OP_INT, do_int3);
+		SET_HANDLER3(OP_PRINT, do_print3, 0);
+		SET_HANDLER3(OP_PRINT, do_print3, 1);
+		SET_HANDLER3(OP_INPUT, do_input3, 0);
+		SET_HANDLER3(OP_MOV, do_mov3, 0);
+		SET_HANDLER3(OP_MOV, do_mov3, 1);
+		SET_HANDLERS3(OP_ADD, do_add3);
+		SET_HANDLERS3(OP_SUB, do_sub3);
+		SET_HANDLERS3(OP_MUL, do_mul3);
+		SET_HANDLERS3(OP_DIV, do_div3);
+		SET_HANDLERS3(OP_JZ, do_jz3);
+		SET_HANDLERS3(OP_JP, do_jp3);
+		SET_HANDLERS3(OP_JNZ, do_jnz3);
+		SET_HANDLERS3(OP_JNP, do_jnp3);
+#undef SET_HANDLERS3
+#undef SET_HANDLER3
+		handlers[HANDLER_PUSH_POOL] = &&do_push_pool;
+		for (std::size_t i = 0; i < INSTRUCTION_NOPS; ++i)
+			handlers[HANDLERS_POOL + i] = &&do_pool3;
+		return handlers;
+	}
+
+	// ip points to the instruction being executed. The top of stack is
+	// kept in tos, and the slot at sp is stale until SYNC().
+	using word_t = typename Layout::word_t;
+	const word_t* const begin = Layout::begin(*code);
+	const word_t* ip = Layout::at(*code, reg.PC);
+	integer_t steps = reg.STEP;
+	integer_t* const base = stack.data();
+	integer_t* sp = base + reg.SP;
+	integer_t tos = *sp;
+// Write the registers back before leaving the engine.
+#define SYNC() (reg.PC = Layout::pc(*code, ip), reg.STEP = steps, \
+		*sp = tos, reg.SP = sp - base)
+#define DISPATCH() do { \
+		++steps; \
+		goto *Layout::handler(ip, handlers); \
+	} while (0)
+#define NEXT() do { ++ip; DISPATCH(); } while (0)
+#define NEXT3() do { ip += Layout::LEN3; DISPATCH(); } while (0)
+#define JUMP(n) do { ip = begin + (n); DISPATCH(); } while (0)
+#define ARG(i) (Layout::arg(ip, i))
+#define OPERAND ARG(0)
+// Fetch source i of a three-address instruction. is_var is a constant.
+#define FETCH(x, i, is_var) do { \
+		if (!(is_var)) { \
+			x = ARG(i); \
+			break; \
+		} \
+		if (!vars.is_defined(ARG(i))) \
+			goto undefined; \
+		x = vars.value[ARG(i)]; \
+	} while (0)
+// One handler for each combination of the source modes.
+#define HANDLER3(name, n, body) \
+name##_##n: { \
+	integer_t a, b; \
+	FETCH(a, 1, (n) & 1); \
+	FETCH(b, 2, (n) & 2); \
+	body; \
+	NEXT3(); }
+#define HANDLERS3(name, body) \
+	HANDLER3(name, 0, body) \
+	HANDLER3(name, 1, body) \
+	HANDLER3(name, 2, body) \
+	HANDLER3(name, 3, body)
+#define PUSH(n) (*sp++ = tos, tos = (n))
+#define POP() (tos = *--sp)
+
+	DISPATCH();
+
+do_nop:
+	NEXT();
+do_int:
+	assert(OPERAND == 0xff);
+	goto line_number_error;
+do_halt:
+	if (OPERAND == -1) {
+		// the HALT appended by prepare(), i.e. end of program
+		--steps;
+	} else {
+		reg.STOP = 1;
+		++ip;
+	}
+	SYNC();
+	return nullptr;
+do_print: {
+	integer_t n = tos;
+	POP();
+	SYNC();
+	print_number(n);
+	NEXT(); }
+do_input: {
+	SYNC();
+	integer_t n = input_number();
+	PUSH(n);
+	NEXT(); }
+do_push_imm:
+	PUSH(OPERAND);
+	NEXT();
+do_push_var:
+	if (!vars.is_defined(OPERAND))
+		goto undefined;
+	PUSH(vars.value[OPERAND]);
+	NEXT();
+do_pop_var:
+	vars.set(OPERAND, tos);
+	POP();
+	NEXT();
+do_store_var:
+	vars.set(OPERAND, tos);
+	NEXT();
+do_add: {
+	integer_t n = tos;
+	POP();
+	tos = wrapping_add(tos, n);
+	NEXT(); }
+do_sub: {
+	integer_t n = tos;
+	POP();
+	tos = wrapping_sub(tos, n);
+	NEXT(); }
+do_mul: {
+	integer_t n = tos;
+	POP();
+	tos = wrapping_mul(tos, n);
+	NEXT(); }
+do_div: {
+	integer_t n = tos;
+	if (n == 0)
+		goto divided_by_zero;
+	POP();
+	tos /= n;
+	NEXT(); }
+do_jmp:
+	JUMP(OPERAND);
+do_jz: {
+	integer_t n = tos;
+	POP();
+	if (n == 0)
+		JUMP(OPERAND);
+	NEXT(); }
+do_jp: {
+	integer_t n = tos;
+	POP();
+	if (n > 0)
+		JUMP(OPERAND);
+	NEXT(); }
+do_jnz: {
+	integer_t n = tos;
+	POP();
+	if (n != 0)
+		JUMP(OPERAND);
+	NEXT(); }
+do_jnp: {
+	integer_t n = tos;
+	POP();
+	if (n <= 0)
+		JUMP(OPERAND);
+	NEXT(); }
+
+HANDLERS3(do_int3, (void)a; (void)b; goto line_number_error)
+do_print3_0:
+	SYNC();
+	print_number(OPERAND);
+	NEXT3();
+do_print3_1: {
+	integer_t a;
+	FETCH(a, 0, 1);
+	SYNC();
+	print_number(a);
+	NEXT3(); }
+do_input3_0: {
+	SYNC();
+	integer_t n = input_number();
+	vars.set(OPERAND, n);
+	NEXT3(); }
+do_mov3_0:
+	vars.set(OPERAND, ARG(1));
+	NEXT3();
+do_mov3_1: {
+	integer_t a;
+	FETCH(a, 1, 1);
+	vars.set(OPERAND, a);
+	NEXT3(); }
+HANDLERS3(do_add3, vars.set(OPERAND, wrapping_add(a, b)))
+HANDLERS3(do_sub3, vars.set(OPERAND, wrapping_sub(a, b)))
+HANDLERS3(do_mul3, vars.set(OPERAND, wrapping_mul(a, b)))
+HANDLERS3(do_div3,
+	if (b == 0)
+		goto divided_by_zero;
+	vars.set(OPERAND, a / b))
+HANDLERS3(do_jz3,
+	if (wrapping_sub(a, b) == 0)
+		JUMP(OPERAND))
+HANDLERS3(do_jp3,
+	if (wrapping_sub(a, b) > 0)
+		JUMP(OPERAND))
+HANDLERS3(do_jnz3,
+	if (wrapping_sub(a, b) != 0)
+		JUMP(OPERAND))
+HANDLERS3(do_jnp3,
+	if (wrapping_sub(a, b) <= 0)
+		JUMP(OPERAND))
+
+do_push_pool:
+	PUSH(Layout::pooled(*code, OPERAND));
+	NEXT();
+do_pool3:
+	// rare enough to go through step_register()
+	SYNC();
+	++reg.PC;
+	step_register(Layout::decode(*code, ip));
+	ip = Layout::at(*code, reg.PC);
+	DISPATCH();
+
+line_number_error:
+	SYNC();
+	throw error::line_number_error();
+undefined:
+	SYNC();
+	throw error::variable_not_defined();
+divided_by_zero:
+	SYNC();
+	throw error::divided_by_zero();
+do_illegal:
+	assert(0);
+	SYNC();
+	return nullptr;
+
+#undef POP
+#undef PUSH
+#undef HANDLERS3
+#undef HANDLER3
+#undef FETCH
+#undef OPERAND
+#undef ARG
+#undef JUMP
+#undef NEXT3
+#undef NEXT
+#undef DISPATCH
+#undef SYNC
+}
+
+void machine::run_threaded(const program& prog)
+{
+	if (_engine == ENGINE_COMPACT)
+		run_threaded<compact_layout>(&prog.compact);
+	else
+		run_threaded<direct_layout>(&prog.threaded);
+}
+
+} // namespace BASIC
+
+#endif // BASIC_HAVE_COMPUTED_GOTO
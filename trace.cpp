@@ -0,0 +1,110 @@
+#include "machine.hpp"
+
+#include "error.hpp"
+
+// The trace engine of machine: the switch engine, counting the backward
+// jumps taken. When jumps back to an instruction have been taken TRACE_HOT
+// times, the path from it until it is reached again is recorded while
+// running, and built into a superblock of closure code, with guards where
+// the path may leave the loop. From then on, the superblock runs the loop
+// whenever a jump goes back there, until a guard fails.
+
+namespace BASIC {
+
+namespace {
+
+constexpr std::uint32_t TRACE_HOT = 64;
+// Longer paths, such as those of loops with loops inside, are left to the
+// switch engine.
+constexpr std::size_t TRACE_MAX = 256;
+
+bool is_jump(const instruction& ins)
+{
+	switch (ins.op_lo >> 4) {
+	case instruction::OP_JMP:
+	case instruction::OP_JZ:
+	case instruction::OP_JP:
+	case instruction::OP_JNZ:
+	case instruction::OP_JNP:
+		return true;
+	default:
+		return false;
+	}
+}
+
+} // namespace
+
+void machine::run_trace(const program& prog)
+{
+	auto& code = prog.code;
+	auto& t = traces;
+	if (t.id != prog.id) {
+		t = trace_cache_t();
+		t.id = prog.id;
+		t.hits.assign(code.size(), 0);
+	}
+	while (!reg.STOP && static_cast<size_t>(reg.PC) < code.size()) {
+		auto pc = reg.PC;
+		auto& ins = code[pc];
+		step(ins);
+		if (!is_jump(ins) || reg.PC > pc)
+			continue;
+		auto it = t.blocks.find(reg.PC);
+		if (it == t.blocks.end()) {
+			if (++t.hits[reg.PC] != TRACE_HOT)
+				continue;
+			auto head = reg.PC;
+			superblock_t sb;
+			if (!record_trace(code, sb))
+				continue;
+			it = t.blocks.emplace(head, std::move(sb)).first;
+		}
+		run_superblock(it->second);
+	}
+}
+
+// Run from reg.PC until it is reached again, and build the path into sb.
+// Return false if the path stops, traps, reads input or is too long, with the machine
+// where it stopped recording. Such loops are not recorded again.
+bool machine::record_trace(const binary_code_t& code, superblock_t& sb)
+{
+	auto head = reg.PC;
+	std::vector<integer_t> path;
+	do {
+		if (reg.STOP || static_cast<size_t>(reg.PC) >= code.size() ||
+				path.size() == TRACE_MAX)
+			return false;
+		auto& ins = code[reg.PC];
+		auto op = ins.op_lo >> 4;
+		// Loops that wait for input are left to step(), which knows
+		// where to stop if there is none yet.
+		if (op == instruction::OP_HALT || op == instruction::OP_INT ||
+				op == instruction::OP_INPUT)
+			return false;
+		path.push_back(reg.PC);
+		step(ins);
+	} while (reg.PC != head);
+	build_superblock(code, path, sb);
+	// a loop of nothing but GOTO
+	return !sb.code.code.empty();
+}
+
+void machine::run_superblock(const superblock_t& sb)
+{
+	auto& code = sb.code.code;
+	std::size_t n = code.size();
+	std::size_t i = 0;
+	while (1) {
+		i = code[i](*this);
+		if (i < n)
+			continue;
+		if (i == n) {
+			i = 0;
+			continue;
+		}
+		reg.PC = sb.exits[i - n - 1];
+		return;
+	}
+}
+
+} // namespace BASIC
@@ -0,0 +1,249 @@
+#include "translator.hpp"
+
+#include "error.hpp"
+
+namespace BASIC {
+
+void translator::translate(const object_code_t& obj, std::ostream& os)
+{
+	std::ostringstream body;
+	out = &body;
+	code = &obj;
+	depth = max_depth = 0;
+	vars.clear();
+	var_set.clear();
+	errors.clear();
+
+	std::unordered_set<std::size_t> targets;
+	for (auto& l : obj) {
+		auto& a = l.second;
+		if (a.type == command::BASIC_GOTO || a.type == command::BASIC_IF)
+			targets.insert(a.target_lineno);
+	}
+	for (auto& l : obj) {
+		if (targets.count(l.first))
+			body << "L" << l.first << ":\n";
+		line(l.second);
+	}
+
+	prelude(os);
+	os << body.str();
+	epilogue(os);
+}
+
+void translator::line(const command& comm)
+{
+	auto& os = *out;
+	switch (comm.type) {
+	case command::BASIC_REM:
+		break;
+	case command::BASIC_LET: {
+		expr(comm.expr);
+		auto v = var(comm.target_var);
+		os << "\t" << v << " = s1;\n";
+		os << "\td" << v << " = true;\n";
+		depth = 0;
+		break; }
+	case command::BASIC_PRINT:
+		expr(comm.expr);
+		os << "\tstd::cout << s1 << '\\n';\n";
+		depth = 0;
+		break;
+	case command::BASIC_INPUT: {
+		// the variable is not touched at end of file
+		auto v = var(comm.target_var);
+		max_depth = std::max<std::size_t>(max_depth, 1);
+		os << "\tif (!input_number(s1))\n";
+		os << "\t\tgoto " << error("end_of_file",
+			error::end_of_file().what()) << ";\n";
+		os << "\t" << v << " = s1;\n";
+		os << "\td" << v << " = true;\n";
+		break; }
+	case command::BASIC_GOTO:
+		jump(comm.target_lineno);
+		break;
+	case command::BASIC_IF: {
+		// The same order of evaluation as the VM, which tests the
+		// wrapping difference of both sides, and traps on a missing
+		// line whatever the difference is.
+		const char* cond;
+		if (comm.cmp == "=") {
+			expr(comm.expr);
+			expr(comm.expr2);
+			cond = "sub(s1, s2) == 0";
+		} else if (comm.cmp == ">") {
+			expr(comm.expr);
+			expr(comm.expr2);
+			cond = "sub(s1, s2) > 0";
+		} else if (comm.cmp == "<") {
+			expr(comm.expr2);
+			expr(comm.expr);
+			cond = "sub(s1, s2) > 0";
+		} else {
+			assert(0);
+		}
+		depth = 0;
+		if (code->count(comm.target_lineno))
+			os << "\tif (" << cond << ")\n\t";
+		else
+			os << "\t(void)s1;\n\t(void)s2;\n";
+		jump(comm.target_lineno);
+		break; }
+	case command::BASIC_END:
+		os << "\treturn 0;\n";
+		break;
+	default:
+		assert(0);
+	}
+}
+
+// Evaluate an expression to s<++depth>, one statement for each token, so
+// that errors happen in the same order as in the VM.
+void translator::expr(const expr_t& expr)
+{
+	auto& os = *out;
+	for (auto& token : expr) {
+		switch (token.type) {
+		case expr_token::IMMEDIATE:
+			++depth;
+			os << "\ts" << depth << " = ";
+			if (token.num == INT64_MIN)
+				os << "INT64_MIN";
+			else
+				os << token.num;
+			os << ";\n";
+			break;
+		case expr_token::VARIABLE: {
+			auto v = var(token.str);
+			++depth;
+			os << "\tif (!d" << v << ")\n";
+			os << "\t\tgoto " << error("variable_not_defined",
+				error::variable_not_defined().what()) << ";\n";
+			os << "\ts" << depth << " = " << v << ";\n";
+			break; }
+		case expr_token::OPERATOR: {
+			auto a = depth - 1;
+			auto b = depth--;
+			if (token.str[0] == '/') {
+				os << "\tif (s" << b << " == 0)\n";
+				os << "\t\tgoto " << error("divided_by_zero",
+					error::divided_by_zero().what()) << ";\n";
+			}
+			os << "\ts" << a << " = ";
+			switch (token.str[0]) {
+			case '+':
+				os << "add(s" << a << ", s" << b << ")";
+				break;
+			case '-':
+				os << "sub(s" << a << ", s" << b << ")";
+				break;
+			case '*':
+				os << "mul(s" << a << ", s" << b << ")";
+				break;
+			case '/':
+				os << "s" << a << " / s" << b;
+				break;
+			default:
+				assert(0);
+			}
+			os << ";\n";
+			break; }
+		default:
+			assert(0);
+		}
+		max_depth = std::max(max_depth, depth);
+	}
+}
+
+void translator::jump(std::size_t lineno)
+{
+	if (code->count(lineno))
+		*out << "\tgoto L" << lineno << ";\n";
+	else
+		*out << "\tgoto " << error("line_number_error",
+			error::line_number_error().what()) << ";\n";
+}
+
+// C++ name of a variable. Its definedness is the same name prefixed by d.
+std::string translator::var(const std::string& name)
+{
+	if (var_set.insert(name).second)
+		vars.push_back(name);
+	return "v_" + name;
+}
+
+std::string translator::error(const std::string& label, const char* message)
+{
+	errors.emplace(label, message);
+	return label;
+}
+
+void translator::prelude(std::ostream& os)
+{
+	os << "// Translated from BASIC by basic-lab2. Build it with a C++11\n"
+		"// compiler, as in c++ -O2 -o prog prog.cpp\n"
+		"\n"
+		"#include <cstdint>\n"
+		"#include <iostream>\n"
+		"#include <sstream>\n"
+		"#include <string>\n"
+		"\n"
+		"using integer_t = std::int64_t;\n"
+		"\n"
+		"// Arithmetic wraps, as in the VM.\n";
+	for (auto op : {"add", "sub", "mul"}) {
+		char c = op[0] == 'a' ? '+' : op[0] == 's' ? '-' : '*';
+		os << "inline integer_t " << op << "(integer_t a, integer_t b)\n"
+			"{\n"
+			"\treturn static_cast<integer_t>(\n"
+			"\t\tstatic_cast<std::uint64_t>(a) " << c << "\n"
+			"\t\tstatic_cast<std::uint64_t>(b));\n"
+			"}\n"
+			"\n";
+	}
+	os << "// INPUT as in interactive_machine. Return false at end of file.\n"
+		"inline bool input_number(integer_t& result)\n"
+		"{\n"
+		"\twhile (1) {\n"
+		"\t\tstd::cout << \" ? \";\n"
+		"\t\tstd::string s;\n"
+		"\t\tstd::getline(std::cin, s);\n"
+		"\t\tif (!std::cin)\n"
+		"\t\t\treturn false;\n"
+		"\t\tstd::istringstream ss(s);\n"
+		"\t\tss >> result;\n"
+		"\t\tif (ss) {\n"
+		"\t\t\tchar ch;\n"
+		"\t\t\tss >> ch;\n"
+		"\t\t\tif (!ss)\n"
+		"\t\t\t\treturn true;\n"
+		"\t\t}\n"
+		"\t\tstd::cout << \"" << error::invalid_number().what()
+			<< "\" << std::endl;\n"
+		"\t}\n"
+		"}\n"
+		"\n"
+		"int main()\n"
+		"{\n";
+	for (std::size_t i = 1; i <= max_depth; ++i)
+		os << "\tinteger_t s" << i << ";\n";
+	for (auto& name : vars) {
+		os << "\tinteger_t v_" << name << " = 0;\n";
+		os << "\tbool dv_" << name << " = false;\n";
+	}
+	if (max_depth || !vars.empty())
+		os << "\n";
+}
+
+void translator::epilogue(std::ostream& os)
+{
+	os << "\treturn 0;\n";
+	for (auto& e : errors) {
+		os << e.first << ":\n";
+		os << "\tstd::cout << \"" << e.second << "\" << std::endl;\n";
+		os << "\treturn 1;\n";
+	}
+	os << "}\n";
+}
+
+} // namespace BASIC
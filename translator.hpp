@@ -0,0 +1,40 @@
+#ifndef BASIC_TRANSLATOR_HPP
+#define BASIC_TRANSLATOR_HPP
+
+#include "common.hpp"
+
+#include "command.hpp"
+
+namespace BASIC {
+
+// Translate object code to a standalone C++ program, which runs it as RUN
+// would with a clear machine, reading input from stdin. Lines become labels,
+// GOTO and IF become goto, and variables become locals of main().
+class translator {
+public:
+	void translate(const object_code_t& obj, std::ostream& os);
+
+private:
+	std::ostream* out;
+	const object_code_t* code;
+	// depth of the expression stack, and its maximum
+	std::size_t depth;
+	std::size_t max_depth;
+	// variables in order of appearance
+	std::vector<std::string> vars;
+	std::unordered_set<std::string> var_set;
+	// labels of errors that are jumped to, and their messages
+	std::map<std::string, std::string> errors;
+
+	void line(const command& comm);
+	void expr(const expr_t& expr);
+	void jump(std::size_t lineno);
+	std::string var(const std::string& name);
+	std::string error(const std::string& label, const char* message);
+	void prelude(std::ostream& os);
+	void epilogue(std::ostream& os);
+};
+
+} // namespace BASIC
+
+#endif // BASIC_TRANSLATOR_HPP